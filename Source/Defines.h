@@ -1,4 +0,0 @@
-#pragma once
-
-#define CROSSFADE 0
-#define DUCKING 1
@@ -0,0 +1,164 @@
+#include <JuceHeader.h>
+#include "DelayBufferPool.h"
+
+#if JUCE_LINUX
+ #include <sys/mman.h>
+#endif
+
+static constexpr size_t pageSize = 4096;
+static constexpr size_t hugePageSize = size_t(2) << 20;
+
+void DelayBufferPool::Releaser::operator()(void* block) const noexcept
+{
+    DelayBufferPool::getInstance().release(block, size);
+}
+
+DelayBufferPool& DelayBufferPool::getInstance()
+{
+    static DelayBufferPool pool;
+    return pool;
+}
+
+DelayBufferPool::~DelayBufferPool()
+{
+    releaseUnused();
+}
+
+DelayBufferPool::Block DelayBufferPool::acquire(size_t size)
+{
+    {
+        std::lock_guard<std::mutex> guard(lock);
+
+        // newest first, it is the most likely to still be in cache
+        for (auto it = unused.rbegin(); it != unused.rend(); ++it)
+        {
+            if (it->size == size)
+            {
+                void* data = it->data;
+                unused.erase(std::next(it).base());
+                unusedBytes -= size;
+                return Block(data, Releaser { size });
+            }
+        }
+    }
+
+    return Block(allocate(size), Releaser { size });
+}
+
+void DelayBufferPool::setUseHugePages(bool shouldUseHugePages) noexcept
+{
+    std::lock_guard<std::mutex> guard(lock);
+    useHugePages = shouldUseHugePages;
+}
+
+void DelayBufferPool::releaseUnused()
+{
+    std::vector<FreeBlock> blocks;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        blocks.swap(unused);
+        unusedBytes = 0;
+    }
+
+    for (auto& block : blocks)
+    {
+        deallocate(block.data, block.size);
+    }
+}
+
+void DelayBufferPool::addUser()
+{
+    std::lock_guard<std::mutex> guard(lock);
+    ++numUsers;
+}
+
+void DelayBufferPool::removeUser()
+{
+    bool wasLast;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        jassert(numUsers > 0);
+        wasLast = --numUsers == 0;
+    }
+
+    if (wasLast)
+    {
+        releaseUnused();
+    }
+}
+
+void DelayBufferPool::release(void* data, size_t size) noexcept
+{
+    if (data == nullptr)
+    {
+        return;
+    }
+
+    std::vector<FreeBlock> excess;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+
+        // The members of the last instance let go of their blocks after it
+        // has been counted out, they are not kept.
+        if (numUsers == 0)
+        {
+            excess.push_back({ data, size });
+        }
+        else
+        {
+            unused.push_back({ data, size });
+            unusedBytes += size;
+
+            // blocks of an old sample rate would otherwise stay forever
+            size_t numExcess = 0;
+            while (unusedBytes > maxUnusedBytes && numExcess < unused.size() - 1)
+            {
+                unusedBytes -= unused[numExcess++].size;
+            }
+            excess.assign(unused.begin(), unused.begin() + static_cast<std::ptrdiff_t>(numExcess));
+            unused.erase(unused.begin(), unused.begin() + static_cast<std::ptrdiff_t>(numExcess));
+        }
+    }
+
+    for (auto& block : excess)
+    {
+        deallocate(block.data, block.size);
+    }
+}
+
+size_t DelayBufferPool::getAlignment(size_t size) noexcept
+{
+    return size >= hugePageSize ? hugePageSize : size_t(64);
+}
+
+void* DelayBufferPool::allocate(size_t size)
+{
+    size_t alignment = getAlignment(size);
+    auto* data = static_cast<char*>(::operator new(size, std::align_val_t(alignment)));
+
+#if JUCE_LINUX && defined(MADV_HUGEPAGE)
+    bool hugePages;
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        hugePages = useHugePages;
+    }
+    if (hugePages && alignment == hugePageSize)
+    {
+        madvise(data, size - size % hugePageSize, MADV_HUGEPAGE);
+    }
+#endif
+
+    // fault the pages in now rather than on the audio thread
+    for (size_t i = 0; i < size; i += pageSize)
+    {
+        data[i] = 0;
+    }
+
+    DBG("DelayBufferPool: " << int(size / 1024) << " kB block allocated");
+    return data;
+}
+
+void DelayBufferPool::deallocate(void* data, size_t size) noexcept
+{
+    ::operator delete(data, std::align_val_t(getAlignment(size)));
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Delay memory shared by all plugin instances in the process. New blocks are
+// aligned and pre-faulted, large ones are 2 MB aligned and advised for huge
+// pages where the platform supports it. Released blocks are kept for reuse by
+// size while any instance is alive, so re-preparing or replacing instances
+// does not go back to the allocator or fault in fresh pages. Once the last
+// one is gone they are returned to the system. Not for the audio thread.
+class DelayBufferPool
+{
+public:
+    // hands the block back to the pool when the owner lets go of it
+    struct Releaser
+    {
+        void operator()(void* block) const noexcept;
+        size_t size = 0;
+    };
+    using Block = std::unique_ptr<void, Releaser>;
+
+    static DelayBufferPool& getInstance();
+
+    // at least size bytes, contents undefined
+    Block acquire(size_t size);
+
+    // huge pages are on by default, they only apply to blocks made afterwards
+    void setUseHugePages(bool shouldUseHugePages) noexcept;
+
+    // returns all unused blocks to the system
+    void releaseUnused();
+
+    // Every plugin instance counts as a user for its lifetime. Without users
+    // nothing is kept.
+    void addUser();
+    void removeUser();
+
+    ~DelayBufferPool();
+
+private:
+    DelayBufferPool() = default;
+
+    struct FreeBlock
+    {
+        void* data;
+        size_t size;
+    };
+
+    void release(void* data, size_t size) noexcept;
+    void* allocate(size_t size);
+    static void deallocate(void* data, size_t size) noexcept;
+    static size_t getAlignment(size_t size) noexcept;
+
+    // unused blocks beyond this are given back, oldest first
+    static constexpr size_t maxUnusedBytes = size_t(256) << 20;
+
+    std::mutex lock;
+    std::vector<FreeBlock> unused;
+    size_t unusedBytes = 0;
+    int numUsers = 0;
+    bool useHugePages = true;
+};
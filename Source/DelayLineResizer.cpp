@@ -0,0 +1,88 @@
+#include "DelayLineResizer.h"
+
+DelayLineResizer::DelayLineResizer(StereoDelayLine& lineToResize)
+    : juce::Thread("Delay Line Resizer"), line(lineToResize)
+{
+}
+
+DelayLineResizer::~DelayLineResizer()
+{
+    stop();
+}
+
+void DelayLineResizer::start()
+{
+    requestedLength = 0;
+    maximumDelay = line.getMaximumDelay();
+    startThread();
+}
+
+void DelayLineResizer::stop()
+{
+    stopThread(1000);
+
+    // nothing is in flight once the thread has stopped
+    delete ready.exchange(nullptr);
+    delete retired.exchange(nullptr);
+}
+
+void DelayLineResizer::update(int maxLengthInSamples, bool nonRealtime) noexcept
+{
+    adoptReady();
+
+    if (line.fits(maxLengthInSamples))
+    {
+        return;
+    }
+
+    requestedLength.store(maxLengthInSamples, std::memory_order_relaxed);
+
+    if (nonRealtime)
+    {
+        while (!line.fits(maxLengthInSamples) && isThreadRunning())
+        {
+            notify();
+            juce::Thread::yield();
+            adoptReady();
+        }
+    }
+}
+
+void DelayLineResizer::adoptReady() noexcept
+{
+    auto* replacement = ready.load(std::memory_order_acquire);
+    if (replacement == nullptr)
+    {
+        return;
+    }
+
+    line.adopt(*replacement);
+    maximumDelay.store(line.getMaximumDelay(), std::memory_order_relaxed);
+
+    // retired before ready is cleared, the thread only fills the next
+    // replacement once the line is done with this one
+    retired.store(replacement, std::memory_order_release);
+    ready.store(nullptr, std::memory_order_release);
+}
+
+void DelayLineResizer::run()
+{
+    while (!threadShouldExit())
+    {
+        if (ready.load(std::memory_order_acquire) == nullptr)
+        {
+            delete retired.exchange(nullptr, std::memory_order_acquire);
+
+            int length = requestedLength.load(std::memory_order_relaxed);
+            if (length > maximumDelay.load(std::memory_order_relaxed))
+            {
+                auto replacement = std::make_unique<StereoDelayLine::Replacement>();
+                line.fillReplacement(*replacement, length);
+                ready.store(replacement.release(), std::memory_order_release);
+                continue;
+            }
+        }
+
+        wait(interval);
+    }
+}
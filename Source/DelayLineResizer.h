@@ -0,0 +1,44 @@
+#pragma once
+#include <JuceHeader.h>
+#include <atomic>
+#include "StereoDelayLine.h"
+
+// Grows a StereoDelayLine while it is in use. The audio thread says once per
+// block how long the line has to be. A background thread allocates the
+// longer buffer, copies the history into it and hands it over through an
+// atomic pointer. The old buffer comes back the same way and is released off
+// the audio thread, so the line can start small.
+class DelayLineResizer : private juce::Thread
+{
+public:
+    explicit DelayLineResizer(StereoDelayLine& lineToResize);
+    ~DelayLineResizer() override;
+
+    // Around anything that changes the line outside of update(), like
+    // setMaximumDelayInSamples() in prepareToPlay(). Not for the audio thread.
+    void start();
+    void stop();
+
+    // Audio thread, before the line is used in a block. Swaps in a grown
+    // buffer once one is ready and asks for one when the line is too short.
+    // Offline there is no deadline, so it waits for the buffer instead.
+    void update(int maxLengthInSamples, bool nonRealtime) noexcept;
+
+private:
+    void run() override;
+    void adoptReady() noexcept;
+
+    StereoDelayLine& line;
+
+    // written by the audio thread, read by the background thread
+    std::atomic<int> requestedLength { 0 };
+    std::atomic<int> maximumDelay { 0 };
+
+    // One replacement at a time: filled and set ready by the background
+    // thread, adopted and retired by the audio thread, then deleted.
+    std::atomic<StereoDelayLine::Replacement*> ready { nullptr };
+    std::atomic<StereoDelayLine::Replacement*> retired { nullptr };
+
+    // how long the thread sleeps between rounds, in milliseconds
+    static constexpr int interval = 5;
+};
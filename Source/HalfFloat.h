@@ -0,0 +1,183 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+// The build does not enable F16C for all of x86, so unless it does, the F16C
+// loops are compiled for it on their own and only run when the CPU has it.
+#if defined(__F16C__)
+ #include <immintrin.h>
+ #define HALF_FLOAT_USE_F16C 1
+#elif defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+ #include <immintrin.h>
+ #define HALF_FLOAT_USE_F16C 1
+ #define HALF_FLOAT_F16C_TARGET __attribute__((target("f16c")))
+#elif defined(_MSC_VER) && !defined(__clang__) && (defined(_M_X64) || defined(_M_IX86))
+ #include <immintrin.h>
+ #include <intrin.h>
+ #define HALF_FLOAT_USE_F16C 1
+ #define HALF_FLOAT_CHECK_CPUID 1
+#elif defined(__aarch64__) || defined(_M_ARM64)
+ #include <arm_neon.h>
+ #define HALF_FLOAT_USE_NEON 1
+#endif
+
+#ifndef HALF_FLOAT_F16C_TARGET
+ #define HALF_FLOAT_F16C_TARGET
+#endif
+
+// Conversion between float and IEEE 754 binary16, rounding to nearest even.
+// The scalar versions are bit-exact with the F16C and NEON instructions, so
+// the storage format does not depend on which path wrote a sample.
+namespace HalfFloat
+{
+    inline std::uint16_t fromFloat(float value) noexcept
+    {
+        std::uint32_t bits;
+        std::memcpy(&bits, &value, sizeof(bits));
+
+        std::uint32_t sign = bits & 0x80000000u;
+        bits ^= sign;
+
+        std::uint32_t half;
+        if (bits >= (127u + 16u) << 23) // too large for a half, or Inf/NaN
+        {
+            half = bits > 0x7f800000u ? 0x7e00u : 0x7c00u;
+        }
+        else if (bits < 113u << 23) // half subnormal or zero
+        {
+            // the addition aligns the 10 mantissa bits and rounds them
+            std::uint32_t magicBits = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+            float magic;
+            std::memcpy(&magic, &magicBits, sizeof(magic));
+
+            float shifted;
+            std::memcpy(&shifted, &bits, sizeof(shifted));
+            shifted += magic;
+            std::memcpy(&half, &shifted, sizeof(half));
+            half -= magicBits;
+        }
+        else
+        {
+            std::uint32_t mantissaOdd = (bits >> 13) & 1u;
+            bits += ((15u - 127u) << 23) + 0xfffu + mantissaOdd;
+            half = bits >> 13;
+        }
+
+        return static_cast<std::uint16_t>(half | (sign >> 16));
+    }
+
+    inline float toFloat(std::uint16_t half) noexcept
+    {
+        std::uint32_t bits = (std::uint32_t(half) & 0x7fffu) << 13;
+        std::uint32_t exponent = bits & (0x7c00u << 13);
+        bits += (127u - 15u) << 23;
+
+        if (exponent == 0x7c00u << 13) // Inf/NaN
+        {
+            bits += (128u - 16u) << 23;
+        }
+        else if (exponent == 0) // zero or subnormal, renormalize
+        {
+            std::uint32_t magicBits = 113u << 23;
+            float magic;
+            std::memcpy(&magic, &magicBits, sizeof(magic));
+
+            bits += 1u << 23;
+            float value;
+            std::memcpy(&value, &bits, sizeof(value));
+            value -= magic;
+            std::memcpy(&bits, &value, sizeof(bits));
+        }
+
+        bits |= (std::uint32_t(half) & 0x8000u) << 16;
+
+        float value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+#if HALF_FLOAT_USE_F16C
+    inline bool hasF16C() noexcept
+    {
+   #if defined(__F16C__)
+        return true;
+   #elif HALF_FLOAT_CHECK_CPUID
+        static const bool supported = []
+        {
+            int info[4];
+            __cpuid(info, 1);
+            return (info[2] & (1 << 29)) != 0;
+        }();
+        return supported;
+   #else
+        return __builtin_cpu_supports("f16c");
+   #endif
+    }
+
+    // both return how many values they converted, a multiple of 4
+    HALF_FLOAT_F16C_TARGET inline int fromFloatF16C(const float* input, std::uint16_t* output, int numValues) noexcept
+    {
+        int i = 0;
+        for (; i + 4 <= numValues; i += 4)
+        {
+            __m128i half = _mm_cvtps_ph(_mm_loadu_ps(input + i), _MM_FROUND_TO_NEAREST_INT);
+            _mm_storel_epi64(reinterpret_cast<__m128i*>(output + i), half);
+        }
+        return i;
+    }
+
+    HALF_FLOAT_F16C_TARGET inline int toFloatF16C(const std::uint16_t* input, float* output, int numValues) noexcept
+    {
+        int i = 0;
+        for (; i + 4 <= numValues; i += 4)
+        {
+            __m128i half = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(input + i));
+            _mm_storeu_ps(output + i, _mm_cvtph_ps(half));
+        }
+        return i;
+    }
+#endif
+
+    inline void fromFloat(const float* input, std::uint16_t* output, int numValues) noexcept
+    {
+        int i = 0;
+#if HALF_FLOAT_USE_F16C
+        if (hasF16C())
+        {
+            i = fromFloatF16C(input, output, numValues);
+        }
+#elif HALF_FLOAT_USE_NEON
+        for (; i + 4 <= numValues; i += 4)
+        {
+            float16x4_t half = vcvt_f16_f32(vld1q_f32(input + i));
+            vst1_u16(output + i, vreinterpret_u16_f16(half));
+        }
+#endif
+        for (; i < numValues; ++i)
+        {
+            output[i] = fromFloat(input[i]);
+        }
+    }
+
+    inline void toFloat(const std::uint16_t* input, float* output, int numValues) noexcept
+    {
+        int i = 0;
+#if HALF_FLOAT_USE_F16C
+        if (hasF16C())
+        {
+            i = toFloatF16C(input, output, numValues);
+        }
+#elif HALF_FLOAT_USE_NEON
+        for (; i + 4 <= numValues; i += 4)
+        {
+            float16x4_t half = vreinterpret_f16_u16(vld1_u16(input + i));
+            vst1q_f32(output + i, vcvt_f32_f16(half));
+        }
+#endif
+        for (; i < numValues; ++i)
+        {
+            output[i] = toFloat(input[i]);
+        }
+    }
+}
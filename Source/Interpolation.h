@@ -0,0 +1,335 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <type_traits>
+
+#if defined(__SSE__) || defined(_M_X64) || defined(_M_AMD64)
+ #include <xmmintrin.h>
+ #define INTERPOLATION_USE_SSE 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+ #include <arm_neon.h>
+ #define INTERPOLATION_USE_NEON 1
+#endif
+
+// Interpolation policies for the delay line. Every policy reads from numTaps
+// consecutive samples of one channel, oldest first and stride floats apart
+// (the channels are interleaved): tap numTaps / 2 is the sample at the
+// integer delay, the one before it one sample older. With four taps, tap 2 is
+// at the integer delay, tap 1 one sample older and tap 3 one sample newer.
+namespace Interpolation
+{
+    // Order matches the choices of the "Interpolation" parameter. Sinc is not
+    // a choice, it replaces the smooth interpolators in offline renders.
+    enum Type
+    {
+        nearest,
+        linear,
+        hermite,
+        lagrange,
+        thiran,
+        sinc
+    };
+
+    // most taps any policy reads, the delay line keeps room for them
+    static constexpr int maxNumTaps = 16;
+
+    // only the allpass interpolator is recursive, the others ignore this
+    struct State
+    {
+        float lastOutput = 0.0f;
+    };
+
+    struct Nearest
+    {
+        static constexpr int numTaps = 4;
+
+        template <int stride>
+        static float interpolate(const float* taps, float fraction, State&) noexcept
+        {
+            return fraction < 0.5f ? taps[2 * stride] : taps[stride];
+        }
+    };
+
+    struct Linear
+    {
+        static constexpr int numTaps = 4;
+
+        template <int stride>
+        static float interpolate(const float* taps, float fraction, State&) noexcept
+        {
+            return taps[2 * stride] + fraction * (taps[stride] - taps[2 * stride]);
+        }
+    };
+
+    // Catmull-Rom spline
+    struct Hermite
+    {
+        static constexpr int numTaps = 4;
+
+        template <int stride>
+        static float interpolate(const float* taps, float fraction, State&) noexcept
+        {
+            float sampleA = taps[3 * stride];
+            float sampleB = taps[2 * stride];
+            float sampleC = taps[stride];
+            float sampleD = taps[0];
+
+            float slope0 = (sampleC - sampleA) * 0.5f;
+            float slope1 = (sampleD - sampleB) * 0.5f;
+            float v = sampleB - sampleC;
+            float w = slope0 + v;
+            float a = w + v + slope1;
+            float b = w + a;
+            float stage1 = a * fraction - b;
+            float stage2 = stage1 * fraction + slope0;
+            return stage2 * fraction + sampleB;
+        }
+    };
+
+    // 3rd-order Lagrange polynomial through the four taps
+    struct Lagrange
+    {
+        static constexpr int numTaps = 4;
+
+        template <int stride>
+        static float interpolate(const float* taps, float fraction, State&) noexcept
+        {
+            float dp1 = fraction + 1.0f;
+            float dm1 = fraction - 1.0f;
+            float dm2 = fraction - 2.0f;
+
+            float a = -fraction * dm1 * dm2 * (1.0f / 6.0f);
+            float b = dp1 * dm1 * dm2 * 0.5f;
+            float c = -dp1 * fraction * dm2 * 0.5f;
+            float d = dp1 * fraction * dm1 * (1.0f / 6.0f);
+            return a * taps[3 * stride] + b * taps[2 * stride] + c * taps[stride] + d * taps[0];
+        }
+    };
+
+    // First-order Thiran allpass. The fractional delay is kept between 0.5
+    // and 1.5 samples, where the allpass has a nearly flat group delay.
+    struct Thiran
+    {
+        static constexpr int numTaps = 4;
+
+        template <int stride>
+        static float interpolate(const float* taps, float fraction, State& state) noexcept
+        {
+            bool shift = fraction < 0.5f;
+            float delta = shift ? fraction + 1.0f : fraction;
+            float x0 = shift ? taps[3 * stride] : taps[2 * stride];
+            float x1 = shift ? taps[2 * stride] : taps[stride];
+
+            float coeff = (1.0f - delta) / (1.0f + delta);
+            state.lastOutput = coeff * (x0 - state.lastOutput) + x1;
+            return state.lastOutput;
+        }
+    };
+
+#if INTERPOLATION_USE_SSE
+    template <int stride>
+    inline __m128 loadTaps(const float* taps) noexcept
+    {
+        static_assert(stride == 1 || stride == 2);
+        if constexpr (stride == 1)
+        {
+            return _mm_loadu_ps(taps);
+        }
+        else
+        {
+            return _mm_shuffle_ps(_mm_loadu_ps(taps), _mm_loadu_ps(taps + 4), _MM_SHUFFLE(2, 0, 2, 0));
+        }
+    }
+#elif INTERPOLATION_USE_NEON
+    template <int stride>
+    inline float32x4_t loadTaps(const float* taps) noexcept
+    {
+        static_assert(stride == 1 || stride == 2);
+        if constexpr (stride == 1)
+        {
+            return vld1q_f32(taps);
+        }
+        else
+        {
+            return vld2q_f32(taps).val[0];
+        }
+    }
+#endif
+
+    // Kaiser-windowed sinc over 16 taps. Flat to within 0.05 dB up to 0.8 of
+    // Nyquist at any fraction, where Hermite loses up to 7 dB, so modulated
+    // feedback tails stay bright. The kernel is tabulated for 256 fractions
+    // and interpolated linearly between them, every read is two dot products.
+    struct Sinc
+    {
+        static constexpr int numTaps = 16;
+        static constexpr int numPhases = 256;
+
+        struct Table
+        {
+            Table() noexcept
+            {
+                // zeroth-order modified Bessel function, by its power series
+                auto bessel = [] (double x)
+                {
+                    double sum = 1.0;
+                    double term = 1.0;
+                    for (int k = 1; k < 32; ++k)
+                    {
+                        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+                        sum += term;
+                    }
+                    return sum;
+                };
+
+                const double beta = 5.0;
+                const double halfLength = numTaps / 2;
+                const double pi = 3.14159265358979323846;
+
+                for (int phase = 0; phase <= numPhases; ++phase)
+                {
+                    double fraction = double(phase) / numPhases;
+                    double kernel[numTaps];
+                    double sum = 0.0;
+
+                    for (int tap = 0; tap < numTaps; ++tap)
+                    {
+                        // distance from the read position, which is fraction
+                        // older than tap numTaps / 2
+                        double x = tap - halfLength + fraction;
+                        double sinc = x == 0.0 ? 1.0 : std::sin(pi * x) / (pi * x);
+                        double r = x / halfLength;
+                        double window = bessel(beta * std::sqrt(std::max(0.0, 1.0 - r * r))) / bessel(beta);
+                        kernel[tap] = sinc * window;
+                        sum += kernel[tap];
+                    }
+
+                    // unity gain at DC for every fraction
+                    for (int tap = 0; tap < numTaps; ++tap)
+                    {
+                        coefficients[phase][tap] = float(kernel[tap] / sum);
+                    }
+                }
+            }
+
+            alignas(16) float coefficients[numPhases + 1][numTaps];
+        };
+
+        // built on first use, call once off the audio thread
+        static const Table& getTable() noexcept
+        {
+            static const Table table;
+            return table;
+        }
+
+        template <int stride>
+        static float interpolate(const float* taps, float fraction, State&) noexcept
+        {
+            float position = fraction * float(numPhases);
+            int phase = int(position);
+            float weight = position - float(phase);
+            const float* kernel0 = getTable().coefficients[phase];
+            const float* kernel1 = getTable().coefficients[phase + 1];
+
+#if INTERPOLATION_USE_SSE
+            __m128 sum0 = _mm_setzero_ps();
+            __m128 sum1 = _mm_setzero_ps();
+            for (int tap = 0; tap < numTaps; tap += 4)
+            {
+                __m128 samples = loadTaps<stride>(taps + tap * stride);
+                sum0 = _mm_add_ps(sum0, _mm_mul_ps(samples, _mm_load_ps(kernel0 + tap)));
+                sum1 = _mm_add_ps(sum1, _mm_mul_ps(samples, _mm_load_ps(kernel1 + tap)));
+            }
+            __m128 sum = _mm_add_ps(sum0, _mm_mul_ps(_mm_sub_ps(sum1, sum0), _mm_set1_ps(weight)));
+            sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+            sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, _MM_SHUFFLE(1, 1, 1, 1)));
+            return _mm_cvtss_f32(sum);
+#elif INTERPOLATION_USE_NEON
+            float32x4_t sum0 = vdupq_n_f32(0.0f);
+            float32x4_t sum1 = vdupq_n_f32(0.0f);
+            for (int tap = 0; tap < numTaps; tap += 4)
+            {
+                float32x4_t samples = loadTaps<stride>(taps + tap * stride);
+                sum0 = vmlaq_f32(sum0, samples, vld1q_f32(kernel0 + tap));
+                sum1 = vmlaq_f32(sum1, samples, vld1q_f32(kernel1 + tap));
+            }
+            float32x4_t sum = vmlaq_n_f32(sum0, vsubq_f32(sum1, sum0), weight);
+            float32x2_t pair = vadd_f32(vget_low_f32(sum), vget_high_f32(sum));
+            return vget_lane_f32(vpadd_f32(pair, pair), 0);
+#else
+            float sum0 = 0.0f;
+            float sum1 = 0.0f;
+            for (int tap = 0; tap < numTaps; ++tap)
+            {
+                sum0 += taps[tap * stride] * kernel0[tap];
+                sum1 += taps[tap * stride] * kernel1[tap];
+            }
+            return sum0 + (sum1 - sum0) * weight;
+#endif
+        }
+    };
+
+    // Evaluates up to four reads at once, one per lane, and always writes four
+    // outputs. Lanes are processed in order, so a recursive interpolator can
+    // share a single state between lanes holding consecutive samples. Hermite
+    // runs the same arithmetic as Hermite::interpolate(), four lanes per
+    // instruction. The tap loads may read stride - 1 floats past the last tap.
+    template <typename Interpolator, int stride>
+    inline void interpolateLanes(const float* const* taps, const float* fractions,
+                                 State* const* states, float* output, int numLanes) noexcept
+    {
+#if INTERPOLATION_USE_SSE
+        if constexpr (std::is_same_v<Interpolator, Hermite>)
+        {
+            __m128 sampleD = loadTaps<stride>(taps[0]);
+            __m128 sampleC = loadTaps<stride>(taps[1]);
+            __m128 sampleB = loadTaps<stride>(taps[2]);
+            __m128 sampleA = loadTaps<stride>(taps[3]);
+            _MM_TRANSPOSE4_PS(sampleD, sampleC, sampleB, sampleA);
+
+            __m128 fraction = _mm_set_ps(fractions[3], fractions[2], fractions[1], fractions[0]);
+            __m128 half = _mm_set1_ps(0.5f);
+
+            __m128 slope0 = _mm_mul_ps(_mm_sub_ps(sampleC, sampleA), half);
+            __m128 slope1 = _mm_mul_ps(_mm_sub_ps(sampleD, sampleB), half);
+            __m128 v = _mm_sub_ps(sampleB, sampleC);
+            __m128 w = _mm_add_ps(slope0, v);
+            __m128 a = _mm_add_ps(_mm_add_ps(w, v), slope1);
+            __m128 b = _mm_add_ps(w, a);
+            __m128 stage1 = _mm_sub_ps(_mm_mul_ps(a, fraction), b);
+            __m128 stage2 = _mm_add_ps(_mm_mul_ps(stage1, fraction), slope0);
+            _mm_storeu_ps(output, _mm_add_ps(_mm_mul_ps(stage2, fraction), sampleB));
+            return;
+        }
+#elif INTERPOLATION_USE_NEON
+        if constexpr (std::is_same_v<Interpolator, Hermite>)
+        {
+            float32x4x2_t rows01 = vtrnq_f32(loadTaps<stride>(taps[0]), loadTaps<stride>(taps[1]));
+            float32x4x2_t rows23 = vtrnq_f32(loadTaps<stride>(taps[2]), loadTaps<stride>(taps[3]));
+            float32x4_t sampleD = vcombine_f32(vget_low_f32(rows01.val[0]), vget_low_f32(rows23.val[0]));
+            float32x4_t sampleC = vcombine_f32(vget_low_f32(rows01.val[1]), vget_low_f32(rows23.val[1]));
+            float32x4_t sampleB = vcombine_f32(vget_high_f32(rows01.val[0]), vget_high_f32(rows23.val[0]));
+            float32x4_t sampleA = vcombine_f32(vget_high_f32(rows01.val[1]), vget_high_f32(rows23.val[1]));
+
+            float32x4_t fraction = vld1q_f32(fractions);
+
+            float32x4_t slope0 = vmulq_n_f32(vsubq_f32(sampleC, sampleA), 0.5f);
+            float32x4_t slope1 = vmulq_n_f32(vsubq_f32(sampleD, sampleB), 0.5f);
+            float32x4_t v = vsubq_f32(sampleB, sampleC);
+            float32x4_t w = vaddq_f32(slope0, v);
+            float32x4_t a = vaddq_f32(vaddq_f32(w, v), slope1);
+            float32x4_t b = vaddq_f32(w, a);
+            float32x4_t stage1 = vsubq_f32(vmulq_f32(a, fraction), b);
+            float32x4_t stage2 = vaddq_f32(vmulq_f32(stage1, fraction), slope0);
+            vst1q_f32(output, vaddq_f32(vmulq_f32(stage2, fraction), sampleB));
+            return;
+        }
+#endif
+
+        for (int lane = 0; lane < numLanes; ++lane)
+        {
+            output[lane] = Interpolator::template interpolate<stride>(taps[lane], fractions[lane], *states[lane]);
+        }
+    }
+}
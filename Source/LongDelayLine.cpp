@@ -0,0 +1,329 @@
+#include "LongDelayLine.h"
+#include <algorithm>
+#include <limits>
+
+LongDelayLine::LongDelayLine() : juce::Thread("Delay History")
+{
+}
+
+LongDelayLine::~LongDelayLine()
+{
+    release();
+}
+
+bool LongDelayLine::prepare(int maxLengthInSamples)
+{
+    jassert(maxLengthInSamples > 0);
+
+    release();
+
+    // frames are overwritten one history length later, past the longest read
+    historyLength = juce::nextPowerOfTwo(maxLengthInSamples + Interpolation::maxNumTaps);
+    historyMask = historyLength - 1;
+    auto numBytes = historyLength * numChannels * std::int64_t(sizeof(float));
+
+    // Sized by writing the last byte, sparse where the file system allows.
+    // Nothing is read before it has been written, so it is not cleared.
+    file = juce::File::getSpecialLocation(juce::File::tempDirectory)
+        .getNonexistentChildFile("DelayHistory", ".tmp", false);
+    {
+        juce::FileOutputStream stream(file);
+        if (!stream.openedOk() || !stream.setPosition(numBytes - 1) || !stream.writeByte(0))
+        {
+            release();
+            return false;
+        }
+    }
+
+    mappedFile = std::make_unique<juce::MemoryMappedFile>(file, juce::MemoryMappedFile::readWrite);
+    if (mappedFile->getData() == nullptr || std::int64_t(mappedFile->getSize()) < numBytes)
+    {
+        release();
+        return false;
+    }
+    history = static_cast<float*>(mappedFile->getData());
+
+    memory = DelayBufferPool::getInstance().acquire(sizeof(float) * numChannels * windowLength);
+    window = static_cast<float*>(memory.get());
+
+    cacheMemory = DelayBufferPool::getInstance().acquire(sizeof(float) * numStreams * numChannels * numSlots * blockLength);
+    cache = static_cast<float*>(cacheMemory.get());
+
+    writePosition = 0;
+    flushedPosition = 0;
+    validFrom = 0;
+    for (auto& heads : readHeads)
+    {
+        for (auto& head : heads)
+        {
+            head = 0;
+        }
+    }
+    for (auto& block : slotBlocks)
+    {
+        block = -1;
+    }
+
+    DBG("LongDelayLine: " << int(numBytes >> 20) << " MB history in " << file.getFullPathName());
+
+    startThread();
+    return true;
+}
+
+void LongDelayLine::release()
+{
+    stopThread(1000);
+
+    history = nullptr;
+    mappedFile.reset();
+    file.deleteFile();
+    file = juce::File();
+
+    window = nullptr;
+    memory.reset();
+
+    cache = nullptr;
+    cacheMemory.reset();
+}
+
+void LongDelayLine::reset() noexcept
+{
+    validFrom = writePosition.load(std::memory_order_relaxed);
+}
+
+void LongDelayLine::writeBlock(const float* left, const float* right, int numSamples) noexcept
+{
+    jassert(isPrepared());
+    jassert(numSamples < windowLength);
+
+    std::int64_t position = writePosition.load(std::memory_order_relaxed);
+
+    // offline there is no deadline, waiting is better than losing frames
+    if (nonRealtime)
+    {
+        while (position + numSamples - flushedPosition.load(std::memory_order_acquire) > windowLength)
+        {
+            notify();
+            juce::Thread::yield();
+        }
+    }
+
+    for (int sample = 0; sample < numSamples; ++sample)
+    {
+        float* frame = window + numChannels * ((position + sample) & windowMask);
+        frame[0] = left[sample];
+        frame[1] = right[sample];
+    }
+
+    writePosition.store(position + numSamples, std::memory_order_release);
+}
+
+template <typename Interpolator>
+void LongDelayLine::readBlock(int channel, float* output, const float* delayInSamples, int numSamples, Interpolation::State& state,
+                              int stream) noexcept
+{
+    jassert(channel >= 0 && channel < numChannels);
+    jassert(stream >= 0 && stream < numStreams);
+    jassert(isPrepared());
+
+    std::int64_t newest = writePosition.load(std::memory_order_relaxed) - 1;
+
+    // sample i of the block is written numSamples - 1 - i writes from now,
+    // the same addressing as StereoDelayLine::readBlock()
+    std::int64_t start = newest + 1 - numSamples - Interpolator::numTaps / 2;
+
+    // the oldest frame any tap of the block reads
+    std::int64_t first = std::numeric_limits<std::int64_t>::max();
+    for (int sample = 0; sample < numSamples; ++sample)
+    {
+        first = std::min(first, start + sample - int(delayInSamples[sample]));
+    }
+    readHeads[stream][channel].store(first, std::memory_order_release);
+
+    for (int sample = 0; sample < numSamples; ++sample)
+    {
+        float delay = delayInSamples[sample];
+        jassert(delay >= float(Interpolator::numTaps / 2 - 1));
+        jassert(delay + float(numSamples - 1 - sample) <= float(historyLength - Interpolation::maxNumTaps));
+
+        int integerDelay = int(delay);
+        float fraction = delay - float(integerDelay);
+        std::int64_t oldest = start + sample - integerDelay;
+
+        if (nonRealtime)
+        {
+            waitForCache(stream, channel, oldest, oldest + Interpolator::numTaps - 1, newest);
+        }
+
+        float taps[Interpolator::numTaps];
+        for (int i = 0; i < Interpolator::numTaps; ++i)
+        {
+            taps[i] = getSample(oldest + i, channel, newest);
+        }
+        output[sample] = Interpolator::template interpolate<1>(taps, fraction, state);
+    }
+}
+
+// Whether every frame from first to last that is older than the window is in
+// the cache of some stream, or does not need to be.
+bool LongDelayLine::isCached(int channel, std::int64_t first, std::int64_t last, std::int64_t newest) const noexcept
+{
+    first = std::max(first, validFrom);
+    last = std::min(last, newest - windowLength);
+
+    for (std::int64_t block = first >> blockBits; first <= last && block <= last >> blockBits; ++block)
+    {
+        bool found = false;
+        for (int stream = 0; stream < numStreams && !found; ++stream)
+        {
+            found = slotBlocks[getSlot(stream, channel, block)].load(std::memory_order_acquire) == block;
+        }
+        if (!found)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Offline there is no deadline, waiting is better than dropping out. A block
+// can jump between delays further apart than the read-ahead, so the head is
+// moved to frames that are not there.
+void LongDelayLine::waitForCache(int stream, int channel, std::int64_t first, std::int64_t last, std::int64_t newest) noexcept
+{
+    if (isCached(channel, first, last, newest))
+    {
+        return;
+    }
+
+    readHeads[stream][channel].store(first, std::memory_order_release);
+    while (!isCached(channel, first, last, newest) && isThreadRunning())
+    {
+        notify();
+        juce::Thread::yield();
+    }
+}
+
+float LongDelayLine::getSample(std::int64_t frame, int channel, std::int64_t newest) const noexcept
+{
+    if (frame < validFrom)
+    {
+        return 0.0f;
+    }
+
+    if (frame > newest - windowLength)
+    {
+        return window[numChannels * (frame & windowMask) + channel];
+    }
+
+    std::int64_t block = frame >> blockBits;
+    for (int stream = 0; stream < numStreams; ++stream)
+    {
+        int slot = getSlot(stream, channel, block);
+        const auto& slotBlock = slotBlocks[slot];
+        if (slotBlock.load(std::memory_order_acquire) != block)
+        {
+            continue;
+        }
+
+        float sample = cache[(std::int64_t(slot) << blockBits) + (frame & (blockLength - 1))];
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slotBlock.load(std::memory_order_relaxed) == block)
+        {
+            return sample;
+        }
+    }
+
+    // Not read ahead yet, or refilled while this was reading it: drop out
+    // rather than wait.
+    return 0.0f;
+}
+
+void LongDelayLine::run()
+{
+    while (!threadShouldExit())
+    {
+        flush();
+
+        for (int stream = 0; stream < numStreams; ++stream)
+        {
+            for (int channel = 0; channel < numChannels; ++channel)
+            {
+                readAhead(stream, channel);
+            }
+        }
+
+        wait(interval);
+    }
+}
+
+void LongDelayLine::flush() noexcept
+{
+    std::int64_t end = writePosition.load(std::memory_order_acquire);
+    std::int64_t start = flushedPosition.load(std::memory_order_relaxed);
+
+    while (start < end)
+    {
+        std::int64_t historyIndex = start & historyMask;
+        std::int64_t windowIndex = start & windowMask;
+        std::int64_t span = std::min({ end - start, historyLength - historyIndex, std::int64_t(windowLength) - windowIndex });
+        float* destination = history + numChannels * historyIndex;
+
+        // Frames the audio thread has overwritten before they were flushed
+        // are lost. Silence is better than the audio from a history ago.
+        if (start < end - windowLength)
+        {
+            span = std::min(span, end - windowLength - start);
+            std::fill_n(destination, numChannels * span, 0.0f);
+        }
+        else
+        {
+            std::copy_n(window + numChannels * windowIndex, numChannels * span, destination);
+        }
+
+        start += span;
+    }
+
+    flushedPosition.store(end, std::memory_order_release);
+}
+
+void LongDelayLine::readAhead(int stream, int channel) noexcept
+{
+    std::int64_t head = std::max(std::int64_t(0), readHeads[stream][channel].load(std::memory_order_acquire));
+    std::int64_t flushed = flushedPosition.load(std::memory_order_relaxed);
+
+    // whole blocks only, from the file, nearest to the head first
+    std::int64_t end = std::min(head + readAheadLength, flushed);
+    for (std::int64_t block = head >> blockBits; (block + 1) << blockBits <= end; ++block)
+    {
+        int slot = getSlot(stream, channel, block);
+        auto& slotBlock = slotBlocks[slot];
+        if (slotBlock.load(std::memory_order_relaxed) == block)
+        {
+            continue;
+        }
+
+        slotBlock.store(-1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        float* destination = cache + (std::int64_t(slot) << blockBits);
+        std::int64_t frame = block << blockBits;
+        for (int i = 0; i < blockLength; ++i)
+        {
+            destination[i] = history[numChannels * ((frame + i) & historyMask) + channel];
+        }
+
+        slotBlock.store(block, std::memory_order_release);
+    }
+}
+
+#define INSTANTIATE_READS(Interpolator) \
+    template void LongDelayLine::readBlock<Interpolator>(int, float*, const float*, int, Interpolation::State&, int) noexcept;
+
+INSTANTIATE_READS(Interpolation::Nearest)
+INSTANTIATE_READS(Interpolation::Linear)
+INSTANTIATE_READS(Interpolation::Hermite)
+INSTANTIATE_READS(Interpolation::Lagrange)
+INSTANTIATE_READS(Interpolation::Thiran)
+INSTANTIATE_READS(Interpolation::Sinc)
@@ -0,0 +1,121 @@
+#pragma once
+#include <JuceHeader.h>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include "Interpolation.h"
+#include "DelayBufferPool.h"
+
+// Stereo delay for delays of minutes. The history lives in a memory-mapped
+// temporary file, but the audio thread never touches the file: it writes to
+// a small window in RAM and reads from the window or from a read-ahead cache
+// in RAM. A background thread copies the window to the file behind the write
+// head and copies the file ahead of each read head into the cache, so a page
+// fault or disk access only ever stalls that thread.
+//
+// Reads and writes work like the block versions of StereoDelayLine, with all
+// delays longer than the block: readBlock() first, with the delays shortened
+// by the block length, then writeBlock().
+class LongDelayLine : private juce::Thread
+{
+public:
+    static constexpr int numChannels = 2;
+
+    // Reads of each channel that may be at different delays in the same
+    // block, each with its own read-ahead: the delay and the one a crossfade
+    // goes to.
+    static constexpr int numStreams = 2;
+
+    LongDelayLine();
+    ~LongDelayLine() override;
+
+    // Creates and maps the history file and starts the streaming thread. False
+    // when the file could not be set up. Not for the audio thread.
+    bool prepare(int maxLengthInSamples);
+
+    // stops the thread and deletes the file
+    void release();
+
+    // Silences the history without touching the file, everything written so
+    // far reads as zero. Audio thread.
+    void reset() noexcept;
+
+    bool isPrepared() const noexcept
+    {
+        return history != nullptr;
+    }
+
+    // Offline, the audio thread waits for the write-behind instead of
+    // dropping frames when it gets a whole window ahead.
+    void setNonRealtime(bool isNonRealtime) noexcept
+    {
+        nonRealtime = isNonRealtime;
+    }
+
+    // Samples the write-behind or the read-ahead has not caught up with yet
+    // read as silence, offline the audio thread waits for them instead. Also
+    // tells the thread where to read ahead for the stream.
+    template <typename Interpolator>
+    void readBlock(int channel, float* output, const float* delayInSamples, int numSamples, Interpolation::State& state,
+                   int stream = 0) noexcept;
+    void writeBlock(const float* left, const float* right, int numSamples) noexcept;
+
+private:
+    void run() override;
+    void flush() noexcept;
+    void readAhead(int stream, int channel) noexcept;
+    bool isCached(int channel, std::int64_t first, std::int64_t last, std::int64_t newest) const noexcept;
+    void waitForCache(int stream, int channel, std::int64_t first, std::int64_t last, std::int64_t newest) noexcept;
+    float getSample(std::int64_t frame, int channel, std::int64_t newest) const noexcept;
+
+    // Frames kept in RAM behind the write head, they cover the time the
+    // thread may take to flush: 1.4 s at 48 kHz.
+    static constexpr int windowLength = 1 << 16;
+    static constexpr int windowMask = windowLength - 1;
+
+    // Frames copied ahead of each read head, and the cache they go to: per
+    // stream and channel, blocks of that channel's samples, block b in slot
+    // b & slotMask. Twice the slots the read-ahead spans, so a head never
+    // evicts a block it still reads. A read looks in the blocks of every
+    // stream, so when a crossfade is over the delay finds the blocks read
+    // ahead for it. 2 MB in all.
+    static constexpr int readAheadLength = 1 << 16;
+    static constexpr int blockBits = 12;
+    static constexpr int blockLength = 1 << blockBits;
+    static constexpr int numSlots = 2 * readAheadLength / blockLength;
+    static constexpr int slotMask = numSlots - 1;
+
+    static int getSlot(int stream, int channel, std::int64_t block) noexcept
+    {
+        return (stream * numChannels + channel) * numSlots + int(block & slotMask);
+    }
+
+    // how long the thread sleeps between rounds, in milliseconds
+    static constexpr int interval = 2;
+
+    juce::File file;
+    std::unique_ptr<juce::MemoryMappedFile> mappedFile;
+    float* history = nullptr;
+    std::int64_t historyLength = 0;
+    std::int64_t historyMask = 0;
+
+    DelayBufferPool::Block memory;
+    float* window = nullptr;
+
+    // The block each slot holds, -1 while the thread fills it. The audio
+    // thread checks the tag before and after reading a sample, so a slot
+    // refilled under it reads as silence rather than as the wrong block.
+    DelayBufferPool::Block cacheMemory;
+    float* cache = nullptr;
+    std::atomic<std::int64_t> slotBlocks[numStreams * numChannels * numSlots] {};
+
+    // absolute frame positions, counted from prepare()
+    std::atomic<std::int64_t> writePosition { 0 };
+    std::atomic<std::int64_t> flushedPosition { 0 };
+    std::atomic<std::int64_t> readHeads[numStreams][numChannels] {};
+
+    // frames before this read as silence, only used by the audio thread
+    std::int64_t validFrom = 0;
+
+    bool nonRealtime = false;
+};
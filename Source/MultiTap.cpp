@@ -0,0 +1,186 @@
+#include "MultiTap.h"
+
+void MultiTap::prepareToPlay(double newSampleRate, int samplesPerBlock)
+{
+    sampleRate = static_cast<float>(newSampleRate);
+
+    // tap output and per-sample delays for processBlock()
+    scratch.setSize(2, samplesPerBlock);
+}
+
+void MultiTap::reset() noexcept
+{
+    for (auto& tap : taps)
+    {
+        tap = {};
+    }
+    numActiveTaps = 0;
+}
+
+void MultiTap::update(const Parameters& params, const Tempo& tempo, int numSamples) noexcept
+{
+    float glide = 1.0f - std::exp(-float(numSamples) / (glideTime * sampleRate));
+
+    numActiveTaps = 0;
+    for (int index = 0; index < Parameters::maxTaps; ++index)
+    {
+        auto& tap = taps[static_cast<size_t>(index)];
+        auto setting = static_cast<size_t>(index);
+
+        float delayTime = params.tapTime[setting];
+        if (params.tempoSync)
+        {
+            delayTime = static_cast<float>(tempo.getMillisecondsForNoteLength(params.tapNote[setting]));
+            delayTime = std::min(delayTime, params.getDelayTimeLimit());
+        }
+        float targetDelay = delayTime / 1000.0f * sampleRate;
+
+        float targetLevel = index < params.tapCount ? params.tapLevel[setting] : 0.0f;
+        float pan = params.tapPan[setting];
+
+        bool wasSilent = tap.level.end == 0.0f;
+        tap.level.rampTo(targetLevel, numSamples);
+
+        if (wasSilent)
+        {
+            // nothing to glide from, a tap that comes in starts at its own time
+            tap.delay.jumpTo(targetDelay);
+            tap.balanceL.jumpTo(std::min(1.0f, 1.0f - pan));
+            tap.balanceR.jumpTo(std::min(1.0f, 1.0f + pan));
+        }
+        else
+        {
+            float delay = tap.delay.end + (targetDelay - tap.delay.end) * glide;
+            if (std::abs(targetDelay - delay) < 0.01f)
+            {
+                delay = targetDelay;
+            }
+            tap.delay.rampTo(delay, numSamples);
+            tap.balanceL.rampTo(std::min(1.0f, 1.0f - pan), numSamples);
+            tap.balanceR.rampTo(std::min(1.0f, 1.0f + pan), numSamples);
+        }
+
+        if (tap.level.value > 0.0f || tap.level.end > 0.0f)
+        {
+            activeTaps[static_cast<size_t>(numActiveTaps++)] = index;
+        }
+    }
+}
+
+float MultiTap::getMinimumDelay() const noexcept
+{
+    float minDelay = std::numeric_limits<float>::max();
+    for (int i = 0; i < numActiveTaps; ++i)
+    {
+        const auto& tap = taps[static_cast<size_t>(activeTaps[static_cast<size_t>(i)])];
+        minDelay = std::min(minDelay, std::min(tap.delay.value, tap.delay.end));
+    }
+    return minDelay;
+}
+
+template <typename Interpolator>
+void MultiTap::processSample(const StereoDelayLine& delayLine, float& left, float& right) noexcept
+{
+    // two stereo taps per gather, the lanes are L and R of each
+    for (int i = 0; i < numActiveTaps; i += 2)
+    {
+        int numLanes = i + 1 < numActiveTaps ? 4 : 2;
+        auto& tapA = taps[static_cast<size_t>(activeTaps[static_cast<size_t>(i)])];
+        auto& tapB = taps[static_cast<size_t>(activeTaps[static_cast<size_t>(numLanes == 4 ? i + 1 : i)])];
+
+        float delays[] = { tapA.delay.value, tapA.delay.value, tapB.delay.value, tapB.delay.value };
+        Interpolation::State* states[] = { &tapA.interpolationL, &tapA.interpolationR,
+                                           &tapB.interpolationL, &tapB.interpolationR };
+        float wet[4];
+        delayLine.readLanes<Interpolator>(delays, states, wet, numLanes);
+
+        left += wet[0] * (tapA.level.value * tapA.balanceL.value);
+        right += wet[1] * (tapA.level.value * tapA.balanceR.value);
+        advance(tapA);
+
+        if (numLanes == 4)
+        {
+            left += wet[2] * (tapB.level.value * tapB.balanceL.value);
+            right += wet[3] * (tapB.level.value * tapB.balanceR.value);
+            advance(tapB);
+        }
+    }
+}
+
+template <typename Interpolator>
+void MultiTap::processSample(const StereoDelayLine& delayLine, float& mono) noexcept
+{
+    for (int i = 0; i < numActiveTaps; ++i)
+    {
+        auto& tap = taps[static_cast<size_t>(activeTaps[static_cast<size_t>(i)])];
+        mono += delayLine.read<Interpolator>(0, tap.delay.value, tap.interpolationL) * tap.level.value;
+        advance(tap);
+    }
+}
+
+template <typename Interpolator>
+void MultiTap::processBlock(const StereoDelayLine& delayLine, float* left, float* right, int numSamples) noexcept
+{
+    jassert(numSamples <= scratch.getNumSamples());
+
+    float* wet = scratch.getWritePointer(0);
+    float* delays = scratch.getWritePointer(1);
+
+    // nothing of this block has been written yet, see processStaged()
+    float blockLength = float(numSamples);
+
+    for (int i = 0; i < numActiveTaps; ++i)
+    {
+        auto& tap = taps[static_cast<size_t>(activeTaps[static_cast<size_t>(i)])];
+
+        for (int channel = 0; channel < StereoDelayLine::numChannels; ++channel)
+        {
+            auto& state = channel == 0 ? tap.interpolationL : tap.interpolationR;
+            if (tap.delay.increment == 0.0f)
+            {
+                delayLine.readBlock<Interpolator>(channel, wet, numSamples, tap.delay.value - blockLength, state);
+            }
+            else
+            {
+                float delay = tap.delay.value;
+                for (int sample = 0; sample < numSamples; ++sample)
+                {
+                    delays[sample] = delay - blockLength;
+                    delay += tap.delay.increment;
+                }
+                delayLine.readBlock<Interpolator>(channel, wet, delays, numSamples, state);
+            }
+
+            // same accumulation as advance(), so both paths use the same gains
+            float* output = channel == 0 ? left : right;
+            const auto& balance = channel == 0 ? tap.balanceL : tap.balanceR;
+            float level = tap.level.value;
+            float gain = balance.value;
+            for (int sample = 0; sample < numSamples; ++sample)
+            {
+                output[sample] += wet[sample] * (level * gain);
+                level += tap.level.increment;
+                gain += balance.increment;
+            }
+        }
+
+        // The ramps go on in the next block, which may be the next segment
+        // of the same update. Stepped like processSample() does.
+        for (int sample = 0; sample < numSamples; ++sample)
+        {
+            advance(tap);
+        }
+    }
+}
+
+#define INSTANTIATE_PROCESSING(Interpolator) \
+    template void MultiTap::processSample<Interpolator>(const StereoDelayLine&, float&, float&) noexcept; \
+    template void MultiTap::processSample<Interpolator>(const StereoDelayLine&, float&) noexcept; \
+    template void MultiTap::processBlock<Interpolator>(const StereoDelayLine&, float*, float*, int) noexcept;
+
+INSTANTIATE_PROCESSING(Interpolation::Nearest)
+INSTANTIATE_PROCESSING(Interpolation::Linear)
+INSTANTIATE_PROCESSING(Interpolation::Hermite)
+INSTANTIATE_PROCESSING(Interpolation::Lagrange)
+INSTANTIATE_PROCESSING(Interpolation::Thiran)
+INSTANTIATE_PROCESSING(Interpolation::Sinc)
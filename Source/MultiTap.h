@@ -0,0 +1,88 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include "StereoDelayLine.h"
+#include "Parameters.h"
+#include "Tempo.h"
+
+// Extra echoes read from the main delay line, up to Parameters::maxTaps
+// stereo taps with their own time, level and pan. The taps only add to the
+// wet signal, the feedback loop keeps using the main delay times.
+class MultiTap
+{
+public:
+    void prepareToPlay(double sampleRate, int samplesPerBlock);
+    void reset() noexcept;
+
+    // Picks up the tap settings, numSamples before the next update. Tap times
+    // glide towards their targets, level and pan ramp until then.
+    void update(const Parameters& params, const Tempo& tempo, int numSamples) noexcept;
+
+    // shortest delay any tap reads during this block, in samples
+    float getMinimumDelay() const noexcept;
+
+    // Adds the taps to one frame, right after the frame has been written.
+    // The mono version reads the left channel and ignores the pan.
+    template <typename Interpolator>
+    void processSample(const StereoDelayLine& delayLine, float& left, float& right) noexcept;
+    template <typename Interpolator>
+    void processSample(const StereoDelayLine& delayLine, float& mono) noexcept;
+
+    // Adds the taps to a whole block before the block is written, with the
+    // same result as processSample() for every sample. The ramps are left
+    // where processSample() would leave them.
+    template <typename Interpolator>
+    void processBlock(const StereoDelayLine& delayLine, float* left, float* right, int numSamples) noexcept;
+
+private:
+    // Linear ramp over one block. The next block starts from the end value,
+    // wherever the per-sample steps have left the current value.
+    struct Ramp
+    {
+        void rampTo(float newEnd, int numSamples) noexcept
+        {
+            value = end;
+            end = newEnd;
+            increment = (end - value) / float(numSamples);
+        }
+
+        void jumpTo(float newEnd) noexcept
+        {
+            value = end = newEnd;
+            increment = 0.0f;
+        }
+
+        float value = 0.0f;
+        float end = 0.0f;
+        float increment = 0.0f;
+    };
+
+    struct Tap
+    {
+        Ramp delay;
+        Ramp level;
+        Ramp balanceL;
+        Ramp balanceR;
+        Interpolation::State interpolationL;
+        Interpolation::State interpolationR;
+    };
+
+    void advance(Tap& tap) noexcept
+    {
+        tap.delay.value += tap.delay.increment;
+        tap.level.value += tap.level.increment;
+        tap.balanceL.value += tap.balanceL.increment;
+        tap.balanceR.value += tap.balanceR.increment;
+    }
+
+    std::array<Tap, Parameters::maxTaps> taps;
+
+    // taps that are audible in this block, in tap order
+    std::array<int, Parameters::maxTaps> activeTaps {};
+    int numActiveTaps = 0;
+
+    float sampleRate = 44100.0f;
+    float glideTime = 0.2f; // same 200 ms as the main delay time smoothing
+
+    juce::AudioBuffer<float> scratch;
+};
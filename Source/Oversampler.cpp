@@ -0,0 +1,233 @@
+#include "Oversampler.h"
+#include "Saturation.h"
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64) || defined(_M_AMD64)
+ #include <xmmintrin.h>
+ #define OVERSAMPLER_USE_SSE 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+ #include <arm_neon.h>
+ #define OVERSAMPLER_USE_NEON 1
+#endif
+
+namespace
+{
+    // four lanes: left even, left odd, right even, right odd
+#if OVERSAMPLER_USE_SSE
+    using Quad = __m128;
+
+    inline Quad load(const float* data) noexcept { return _mm_loadu_ps(data); }
+    inline void store(float* data, Quad value) noexcept { _mm_storeu_ps(data, value); }
+    inline Quad makeQuad(float left, float right) noexcept { return _mm_setr_ps(left, left, right, right); }
+    inline Quad add(Quad a, Quad b) noexcept { return _mm_add_ps(a, b); }
+    inline Quad subtract(Quad a, Quad b) noexcept { return _mm_sub_ps(a, b); }
+    inline Quad multiply(Quad a, Quad b) noexcept { return _mm_mul_ps(a, b); }
+    inline Quad swapPhases(Quad value) noexcept { return _mm_shuffle_ps(value, value, _MM_SHUFFLE(2, 3, 0, 1)); }
+#elif OVERSAMPLER_USE_NEON
+    using Quad = float32x4_t;
+
+    inline Quad load(const float* data) noexcept { return vld1q_f32(data); }
+    inline void store(float* data, Quad value) noexcept { vst1q_f32(data, value); }
+    inline Quad makeQuad(float left, float right) noexcept { return vcombine_f32(vdup_n_f32(left), vdup_n_f32(right)); }
+    inline Quad add(Quad a, Quad b) noexcept { return vaddq_f32(a, b); }
+    inline Quad subtract(Quad a, Quad b) noexcept { return vsubq_f32(a, b); }
+    inline Quad multiply(Quad a, Quad b) noexcept { return vmulq_f32(a, b); }
+    inline Quad swapPhases(Quad value) noexcept { return vrev64q_f32(value); }
+#else
+    struct Quad
+    {
+        float lanes[4];
+    };
+
+    inline Quad load(const float* data) noexcept { return { { data[0], data[1], data[2], data[3] } }; }
+    inline void store(float* data, Quad value) noexcept { std::copy_n(value.lanes, 4, data); }
+    inline Quad makeQuad(float left, float right) noexcept { return { { left, left, right, right } }; }
+    inline Quad swapPhases(Quad v) noexcept { return { { v.lanes[1], v.lanes[0], v.lanes[3], v.lanes[2] } }; }
+
+    template <typename Operation>
+    inline Quad apply(Quad a, Quad b, Operation operation) noexcept
+    {
+        Quad result;
+        for (int lane = 0; lane < 4; ++lane)
+        {
+            result.lanes[lane] = operation(a.lanes[lane], b.lanes[lane]);
+        }
+        return result;
+    }
+
+    inline Quad add(Quad a, Quad b) noexcept { return apply(a, b, [] (float x, float y) { return x + y; }); }
+    inline Quad subtract(Quad a, Quad b) noexcept { return apply(a, b, [] (float x, float y) { return x - y; }); }
+    inline Quad multiply(Quad a, Quad b) noexcept { return apply(a, b, [] (float x, float y) { return x * y; }); }
+#endif
+
+    // A stage with its state in registers for the length of a block. Every
+    // step runs both chains of both channels once, at the lower rate.
+    template <typename Stage>
+    class Chains
+    {
+    public:
+        explicit Chains(Stage& stageToRun) noexcept : stage(stageToRun)
+        {
+            const auto& coefficients = Stage::getCoefficients();
+            for (size_t section = 0; section < numSections; ++section)
+            {
+                coefficient[section] = load(coefficients.lanes[section]);
+                input[section] = load(stage.inputs[section]);
+                output[section] = load(stage.outputs[section]);
+            }
+        }
+
+        ~Chains()
+        {
+            for (size_t section = 0; section < numSections; ++section)
+            {
+                store(stage.inputs[section], input[section]);
+                store(stage.outputs[section], output[section]);
+            }
+        }
+
+        Quad step(Quad x) noexcept
+        {
+            for (size_t section = 0; section < numSections; ++section)
+            {
+                Quad y = add(multiply(coefficient[section], subtract(x, output[section])), input[section]);
+                input[section] = x;
+                output[section] = y;
+                x = y;
+            }
+            return x;
+        }
+
+        // One sample of each channel in, the two phases of each out.
+        void upsample(float left, float right, float* output4) noexcept
+        {
+            store(output4, step(makeQuad(left, right)));
+        }
+
+        // The two phases of each channel in, one sample of each out. The odd
+        // input goes through the chain of the even phase and the other way
+        // round, then the chains are summed.
+        void downsample(const float* input4, float& left, float& right) noexcept
+        {
+            alignas(16) float lanes[4];
+            store(lanes, step(swapPhases(load(input4))));
+            left = 0.5f * (lanes[0] + lanes[1]);
+            right = 0.5f * (lanes[2] + lanes[3]);
+        }
+
+    private:
+        static constexpr size_t numSections = Stage::numSections;
+
+        Stage& stage;
+        Quad coefficient[numSections];
+        Quad input[numSections];
+        Quad output[numSections];
+    };
+}
+
+void Oversampler::prepare(int maxBlockSize)
+{
+    // four lanes per step of the stage below
+    work2x.allocate(static_cast<size_t>(4 * maxBlockSize), true);
+    work4x.allocate(static_cast<size_t>(8 * maxBlockSize), true);
+    maxNumSamples = maxBlockSize;
+
+    // built here rather than on the audio thread
+    Stage<Steep>::getCoefficients();
+    Stage<Gentle>::getCoefficients();
+}
+
+void Oversampler::reset() noexcept
+{
+    upsampler.reset();
+    downsampler.reset();
+    upsampler4x.reset();
+    downsampler4x.reset();
+}
+
+void Oversampler::processBlock(int order, int saturation, float* left, float* right, int numSamples) noexcept
+{
+    jassert(order > 0 && order <= maxOrder);
+    jassert(numSamples <= maxNumSamples);
+
+    // at 2x: left 2s, left 2s + 1, right 2s, right 2s + 1 for sample s
+    float* oversampled = work2x.get();
+    {
+        Chains<Stage<Steep>> chains(upsampler);
+        for (int sample = 0; sample < numSamples; ++sample)
+        {
+            chains.upsample(left[sample], right[sample], oversampled + 4 * sample);
+        }
+    }
+
+    if (order == 1)
+    {
+        Saturation::processBlock(saturation, oversampled, 4 * numSamples);
+    }
+    else
+    {
+        // each 2x step in turn, the same layout one level up
+        float* oversampled4x = work4x.get();
+        {
+            Chains<Stage<Gentle>> chains(upsampler4x);
+            for (int step = 0; step < 2 * numSamples; ++step)
+            {
+                const float* group = oversampled + 4 * (step / 2) + step % 2;
+                chains.upsample(group[0], group[2], oversampled4x + 4 * step);
+            }
+        }
+
+        Saturation::processBlock(saturation, oversampled4x, 8 * numSamples);
+
+        {
+            Chains<Stage<Gentle>> chains(downsampler4x);
+            for (int step = 0; step < 2 * numSamples; ++step)
+            {
+                float* group = oversampled + 4 * (step / 2) + step % 2;
+                chains.downsample(oversampled4x + 4 * step, group[0], group[2]);
+            }
+        }
+    }
+
+    Chains<Stage<Steep>> chains(downsampler);
+    for (int sample = 0; sample < numSamples; ++sample)
+    {
+        chains.downsample(oversampled + 4 * sample, left[sample], right[sample]);
+    }
+}
+
+// Allpass coefficients of a polyphase half-band filter with an elliptic
+// response, the closed-form design of Valenzuela and Constantinides. The
+// transition band is centred on a quarter of the higher rate.
+void Oversampler::design(float* coefficients, int numCoefficients, double transition) noexcept
+{
+    const double pi = 3.14159265358979323846;
+
+    double k = std::pow(std::tan((1.0 - 2.0 * transition) * pi / 4.0), 2.0);
+    double kRoot = std::pow(1.0 - k * k, 0.25);
+    double e = 0.5 * (1.0 - kRoot) / (1.0 + kRoot);
+    double e4 = std::pow(e, 4.0);
+    double q = e * (1.0 + e4 * (2.0 + e4 * (15.0 + 150.0 * e4))); // elliptic nome
+    int order = 2 * numCoefficients + 1;
+
+    for (int index = 0; index < numCoefficients; ++index)
+    {
+        int c = index + 1;
+
+        // theta function series, they converge after a few terms
+        double numerator = 0.0;
+        double denominator = 0.0;
+        double sign = 1.0;
+        for (int i = 0; i < 16; ++i)
+        {
+            numerator += sign * std::pow(q, i * (i + 1)) * std::sin((2 * i + 1) * c * pi / order);
+            denominator -= sign * std::pow(q, (i + 1) * (i + 1)) * std::cos(2 * (i + 1) * c * pi / order);
+            sign = -sign;
+        }
+
+        double w = numerator * std::pow(q, 0.25) / (denominator + 0.5);
+        double w2 = w * w;
+        double x = std::sqrt((1.0 - w2 * k) * (1.0 - w2 / k)) / (1.0 + w2);
+        coefficients[index] = float((1.0 - x) / (1.0 + x));
+    }
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <JuceHeader.h>
+
+// Runs the feedback saturation at 2x or 4x the sample rate, so the harmonics
+// it adds above Nyquist are filtered out instead of folding back and going
+// round the loop again. Each factor of 2 is a polyphase half-band IIR: two
+// chains of first-order allpasses at the lower rate, one per output phase
+// going up and one per input phase coming down. There and back the signal is
+// only allpass filtered, about 2.6 samples of delay at low frequencies for
+// 2x and 3.5 for 4x, which add to the time around the loop.
+class Oversampler
+{
+public:
+    // the factor is 2^order, order 0 is not oversampled
+    static constexpr int maxOrder = 2;
+
+    void prepare(int maxBlockSize);
+    void reset() noexcept;
+
+    // The saturation curve over both channels of a block, in place, with the
+    // drive already applied. Blocks of one sample are fine.
+    void processBlock(int order, int saturation, float* left, float* right, int numSamples) noexcept;
+
+private:
+    // Half-band designs: the number of allpasses in both chains together and
+    // the transition band as a fraction of the higher rate. The first one
+    // passes up to 0.46 of the lower rate and rejects images by 81 dB. The
+    // second one only sees content up to 0.25 of its lower rate and gets by
+    // with half the allpasses, 70 dB.
+    struct Steep
+    {
+        static constexpr int numCoefficients = 8;
+        static constexpr double transition = 0.02;
+    };
+
+    struct Gentle
+    {
+        static constexpr int numCoefficients = 4;
+        static constexpr double transition = 0.1;
+    };
+
+    static void design(float* coefficients, int numCoefficients, double transition) noexcept;
+
+    // One factor of 2 in one direction. Both channels and both phases run
+    // side by side in four lanes: left even, left odd, right even, right odd.
+    // The even coefficients make the chain of the even phase, the odd ones
+    // the chain of the odd phase.
+    template <typename Design>
+    struct Stage
+    {
+        static constexpr size_t numSections = Design::numCoefficients / 2;
+
+        struct Coefficients
+        {
+            Coefficients() noexcept
+            {
+                float values[Design::numCoefficients];
+                design(values, Design::numCoefficients, Design::transition);
+
+                for (size_t section = 0; section < numSections; ++section)
+                {
+                    for (size_t lane = 0; lane < 4; ++lane)
+                    {
+                        lanes[section][lane] = values[2 * section + lane % 2];
+                    }
+                }
+            }
+
+            alignas(16) float lanes[numSections][4];
+        };
+
+        // built on first use, call once off the audio thread
+        static const Coefficients& getCoefficients() noexcept
+        {
+            static const Coefficients coefficients;
+            return coefficients;
+        }
+
+        void reset() noexcept
+        {
+            *this = Stage();
+        }
+
+        // last input and output of every allpass
+        alignas(16) float inputs[numSections][4] = {};
+        alignas(16) float outputs[numSections][4] = {};
+    };
+
+    Stage<Steep> upsampler, downsampler;
+    Stage<Gentle> upsampler4x, downsampler4x;
+
+    // the block at 2x and at 4x, four lanes per step
+    juce::HeapBlock<float> work2x, work4x;
+    int maxNumSamples = 0;
+};
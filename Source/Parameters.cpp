@@ -1,6 +1,5 @@
 #include "Parameters.h"
 #include "DSP.h"
-#include "Defines.h"
 
 template<typename T>
 static void castParameter(juce::AudioProcessorValueTreeState& apvts,
@@ -81,6 +80,26 @@ static float hzFromString(const juce::String& str)
   return value;  
 }
 
+juce::ParameterID tapTimeParamID(int tap)
+{
+  return { "tapTime" + juce::String(tap + 1), 1 };
+}
+
+juce::ParameterID tapNoteParamID(int tap)
+{
+  return { "tapNote" + juce::String(tap + 1), 1 };
+}
+
+juce::ParameterID tapLevelParamID(int tap)
+{
+  return { "tapLevel" + juce::String(tap + 1), 1 };
+}
+
+juce::ParameterID tapPanParamID(int tap)
+{
+  return { "tapPan" + juce::String(tap + 1), 1 };
+}
+
 Parameters::Parameters(juce::AudioProcessorValueTreeState& apvts)
 {
   castParameter(apvts, gainParamID, gainParam);
@@ -99,6 +118,24 @@ Parameters::Parameters(juce::AudioProcessorValueTreeState& apvts)
   castParameter(apvts, delayNoteRParamID, delayNoteRParam);
   castParameter(apvts, tempoSyncParamID, tempoSyncParam);
   castParameter(apvts, bypassParamID, bypassParam);
+  castParameter(apvts, interpolationParamID, interpolationParam);
+  castParameter(apvts, timeChangeParamID, timeChangeParam);
+  castParameter(apvts, saturationParamID, saturationParam);
+  castParameter(apvts, oversamplingParamID, oversamplingParam);
+  castParameter(apvts, compactMemoryParamID, compactMemoryParam);
+  castParameter(apvts, clearOnBypassParamID, clearOnBypassParam);
+  castParameter(apvts, longDelayParamID, longDelayParam);
+  castParameter(apvts, longDelayTimeParamID, longDelayTimeParam);
+  castParameter(apvts, tapCountParamID, tapCountParam);
+
+  for (int tap = 0; tap < maxTaps; ++tap)
+  {
+    auto index = static_cast<size_t>(tap);
+    castParameter(apvts, tapTimeParamID(tap), tapTimeParams[index]);
+    castParameter(apvts, tapNoteParamID(tap), tapNoteParams[index]);
+    castParameter(apvts, tapLevelParamID(tap), tapLevelParams[index]);
+    castParameter(apvts, tapPanParamID(tap), tapPanParams[index]);
+  }
 }
 
 juce::AudioProcessorValueTreeState::ParameterLayout Parameters::createParameterLayout()
@@ -235,46 +272,168 @@ juce::AudioProcessorValueTreeState::ParameterLayout Parameters::createParameterL
   parameterLayout.add(std::make_unique<juce::AudioParameterBool>(
     bypassParamID, "Bypass", false));
 
+  // Whether switching the plugin back on starts from silence or carries on
+  // with the echoes that were there when it was bypassed
+  parameterLayout.add(std::make_unique<juce::AudioParameterBool>(
+    clearOnBypassParamID, "Clear Delay On Bypass", true,
+    juce::AudioParameterBoolAttributes().withAutomatable(false)));
+
+  // cheap interpolation for live use, better ones for mixdown
+  parameterLayout.add(std::make_unique<juce::AudioParameterChoice>(
+    interpolationParamID, "Interpolation",
+    juce::StringArray { "Nearest", "Linear", "Hermite", "Lagrange", "Thiran" },
+    Interpolation::hermite));
+
+  // how the delay moves to a new time: glide repitches, crossfade and duck
+  // jump without a pitch change
+  parameterLayout.add(std::make_unique<juce::AudioParameterChoice>(
+    timeChangeParamID, "Time Change",
+    juce::StringArray { "Glide", "Crossfade", "Duck" },
+    TimeChange::duck));
+
+  // The curve in the feedback path: tanh itself, or a cheaper stand-in.
+  // Exact by default, so sessions from before this choice sound the same.
+  parameterLayout.add(std::make_unique<juce::AudioParameterChoice>(
+    saturationParamID, "Saturation",
+    juce::StringArray { "Exact", "Rational", "Polynomial", "Table" },
+    Saturation::exact));
+
+  // Runs the saturation at a higher rate once the drive is above
+  // minOversamplingDrive, so it does not alias.
+  parameterLayout.add(std::make_unique<juce::AudioParameterChoice>(
+    oversamplingParamID, "Oversampling",
+    juce::StringArray { "Off", "2x", "4x" },
+    1));
+
+  // Half-float delay memory. Not automatable, it takes effect the next time
+  // the host prepares the plugin.
+  parameterLayout.add(std::make_unique<juce::AudioParameterBool>(
+    compactMemoryParamID, "Compact Delay Memory", false,
+    juce::AudioParameterBoolAttributes().withAutomatable(false)));
+
+  // Delays of minutes from a history file on disk, for looping and ambient
+  // patches. Not automatable either, the file is set up when the host
+  // prepares the plugin. The taps are not used in this mode.
+  parameterLayout.add(std::make_unique<juce::AudioParameterBool>(
+    longDelayParamID, "Long Delay", false,
+    juce::AudioParameterBoolAttributes().withAutomatable(false)));
+
+  parameterLayout.add(std::make_unique<juce::AudioParameterFloat>(longDelayTimeParamID,
+    "Long Delay Time",
+    juce::NormalisableRange<float> {maxDelayTime, maxLongDelayTime, 0.001f, 0.25f},
+    30000.0f,
+    juce::AudioParameterFloatAttributes()
+    .withStringFromValueFunction(stringFromMilliseconds)
+    .withValueFromStringFunction(millisecondsFromString)
+    ));
+
+  // 0 taps is the plain stereo delay, each tap adds an echo to the wet
+  // signal that is not fed back
+  parameterLayout.add(std::make_unique<juce::AudioParameterInt>(
+    tapCountParamID, "Taps", 0, maxTaps, 0));
+
+  for (int tap = 0; tap < maxTaps; ++tap)
+  {
+    juce::String name = "Tap " + juce::String(tap + 1);
+
+    parameterLayout.add(std::make_unique<juce::AudioParameterFloat>(tapTimeParamID(tap),
+      name + " Time",
+      juce::NormalisableRange<float> {minDelayTime, maxDelayTime, 0.001f, 0.25f},
+      100.0f * float(tap + 1),
+      juce::AudioParameterFloatAttributes()
+      .withStringFromValueFunction(stringFromMilliseconds)
+      .withValueFromStringFunction(millisecondsFromString)
+      ));
+
+    // 1/16, 1/8, 1/8 dot, 1/4, 1/4 dot, 1/2, 1/2 dot, 1/1
+    static constexpr int defaultNotes[] = { 3, 6, 8, 9, 11, 12, 14, 15 };
+    parameterLayout.add(std::make_unique<juce::AudioParameterChoice>(
+      tapNoteParamID(tap), name + " Note", noteLengths, defaultNotes[tap]));
+
+    parameterLayout.add(std::make_unique<juce::AudioParameterFloat>(
+      tapLevelParamID(tap),
+      name + " Level",
+      juce::NormalisableRange<float> {0.0f, 100.0f, 1.0f},
+      50.0f,
+      juce::AudioParameterFloatAttributes().withStringFromValueFunction(stringFromPercent)
+      ));
+
+    parameterLayout.add(std::make_unique<juce::AudioParameterFloat>(
+      tapPanParamID(tap),
+      name + " Pan",
+      juce::NormalisableRange<float> {-100.0f, 100.0f, 1.0f},
+      0.0f,
+      juce::AudioParameterFloatAttributes().withStringFromValueFunction(stringFromPercent)
+      ));
+  }
+
   return parameterLayout;
 }
 
 void Parameters::update() noexcept
 {
-  gainSmoother.setTargetValue(juce::Decibels::decibelsToGain(gainParam->get()));
+  gainSmoother.setBlockTarget(juce::Decibels::decibelsToGain(gainParam->get()));
 
-  targetDelayTimeL = delayTimeLParam->get();
+  targetDelayTimeL = longDelayMode ? longDelayTimeParam->get() : delayTimeLParam->get();
   if (delayTimeL == 0.0f)
   {
     delayTimeL = targetDelayTimeL;
   }
 
-  targetDelayTimeR = delayTimeRParam->get();
+  targetDelayTimeR = longDelayMode ? longDelayTimeParam->get() : delayTimeRParam->get();
   if (delayTimeR == 0.0f)
   {
     delayTimeR = targetDelayTimeR;
   }
   
-  mixSmoother.setTargetValue(mixParam->get() * 0.01f);
-  feedbackSmoother.setTargetValue(feedbackParam->get() * 0.01f);
-  stereoSmoother.setTargetValue(stereoParam->get() * 0.01f);
-  lowCutSmoother.setTargetValue(lowCutParam->get());
-  highCutSmoother.setTargetValue(highCutParam->get());
-  lowCutQSmoother.setTargetValue(lowCutQParam->get());
-  highCutQSmoother.setTargetValue(highCutQParam->get());
-  driveSmoother.setTargetValue(juce::Decibels::decibelsToGain(driveParam->get()));
-  postWSGainSmoother.setTargetValue(juce::Decibels::decibelsToGain(postWSGainParam->get()));
+  mixSmoother.setBlockTarget(mixParam->get() * 0.01f);
+  feedbackSmoother.setBlockTarget(feedbackParam->get() * 0.01f);
+  stereoSmoother.setBlockTarget(stereoParam->get() * 0.01f);
+  lowCutSmoother.setBlockTarget(lowCutParam->get());
+  highCutSmoother.setBlockTarget(highCutParam->get());
+  lowCutQSmoother.setBlockTarget(lowCutQParam->get());
+  highCutQSmoother.setBlockTarget(highCutQParam->get());
+  driveSmoother.setBlockTarget(juce::Decibels::decibelsToGain(driveParam->get()));
+  postWSGainSmoother.setBlockTarget(juce::Decibels::decibelsToGain(postWSGainParam->get()));
   delayNoteL = delayNoteLParam->getIndex();
   delayNoteR = delayNoteRParam->getIndex();
-  tempoSync = tempoSyncParam->get();
+  tempoSync = tempoSyncParam->get() && !longDelayMode;
   bypassed = bypassParam->get();
+  interpolation = interpolationParam->getIndex();
+  timeChange = timeChangeParam->getIndex();
+  saturation = saturationParam->getIndex();
+
+  // clean patches barely saturate, they are not worth the oversampling
+  oversampling = driveParam->get() > minOversamplingDrive ? oversamplingParam->getIndex() : 0;
+
+  tapCount = tapCountParam->get();
+  for (size_t tap = 0; tap < maxTaps; ++tap)
+  {
+    tapTime[tap] = tapTimeParams[tap]->get();
+    tapNote[tap] = tapNoteParams[tap]->getIndex();
+    tapLevel[tap] = tapLevelParams[tap]->get() * 0.01f;
+    tapPan[tap] = tapPanParams[tap]->get() * 0.01f;
+  }
+}
+
+void Parameters::updateSegment(float progress) noexcept
+{
+  gainSmoother.setSegmentTarget(progress);
+  mixSmoother.setSegmentTarget(progress);
+  feedbackSmoother.setSegmentTarget(progress);
+  stereoSmoother.setSegmentTarget(progress);
+  lowCutSmoother.setSegmentTarget(progress);
+  highCutSmoother.setSegmentTarget(progress);
+  lowCutQSmoother.setSegmentTarget(progress);
+  highCutQSmoother.setSegmentTarget(progress);
+  driveSmoother.setSegmentTarget(progress);
+  postWSGainSmoother.setSegmentTarget(progress);
 }
 
 void Parameters::prepareToPlay(double sampleRate) noexcept
 {
   double duration = 0.02;
   gainSmoother.reset(sampleRate, duration);
-  coeffL = 1.0f - std::exp(-1.0f / (0.2f * static_cast<float>(sampleRate))); // 0.2f -> decay time 200 ms
-  coeffR = 1.0f - std::exp(-1.0f / (0.2f * static_cast<float>(sampleRate))); // 0.2f -> decay time 200 ms
   mixSmoother.reset(sampleRate, duration);
   feedbackSmoother.reset(sampleRate, duration);
   stereoSmoother.reset(sampleRate, duration);
@@ -311,17 +470,48 @@ void Parameters::reset() noexcept
   postWSGainSmoother.setCurrentAndTargetValue(juce::Decibels::decibelsToGain(postWSGainParam->get()));
 }
 
+void Parameters::setDelayTimeLimit(float limit) noexcept
+{
+  delayTimeLimit = std::min(limit, maxDelayTime);
+
+  // the long delay times do not use the delay line
+  if (!longDelayMode)
+  {
+    targetDelayTimeL = std::min(targetDelayTimeL, delayTimeLimit);
+    targetDelayTimeR = std::min(targetDelayTimeR, delayTimeLimit);
+    delayTimeL = std::min(delayTimeL, delayTimeLimit);
+    delayTimeR = std::min(delayTimeR, delayTimeLimit);
+  }
+
+  for (auto& time : tapTime)
+  {
+    time = std::min(time, delayTimeLimit);
+  }
+}
+
+// peak gain of the state variable filters, above 1 once they resonate
+static float getResonancePeak(float q) noexcept
+{
+  return q > 0.7072f ? q / std::sqrt(1.0f - 1.0f / (4.0f * q * q)) : 1.0f;
+}
+
+float Parameters::getLoopGain() const noexcept
+{
+  // tanh has a slope of 1 at 0, the drive sets the gain into it. Negative
+  // feedback flips the sign every pass, the echoes decay just as slowly.
+  return std::abs(feedbackParam->get()) * 0.01f
+       * juce::Decibels::decibelsToGain(driveParam->get())
+       * juce::Decibels::decibelsToGain(postWSGainParam->get())
+       * getResonancePeak(lowCutQParam->get())
+       * getResonancePeak(highCutQParam->get());
+}
+
 void Parameters::smoothen() noexcept
 {
   gain = gainSmoother.getNextValue();
-#if CROSSFADE | DUCKING
+  // the processor's time change strategy smooths the delay times
   delayTimeL = targetDelayTimeL;
   delayTimeR = targetDelayTimeR;
-
-#else
-  delayTimeL += (targetDelayTimeL - delayTimeL) * coeffL;
-  delayTimeR += (targetDelayTimeR - delayTimeR) * coeffR;
-#endif
   mix = mixSmoother.getNextValue();
   feedback = feedbackSmoother.getNextValue();
   panningEqualPower(stereoSmoother.getNextValue(), panL, panR);
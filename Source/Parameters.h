@@ -10,6 +10,9 @@
 
 #pragma once
 #include <JuceHeader.h>
+#include "Interpolation.h"
+#include "TimeChange.h"
+#include "Saturation.h"
 
 const juce::ParameterID gainParamID {"gain", 1};
 const juce::ParameterID delayTimeLParamID {"delayTimeL", 1};
@@ -27,6 +30,21 @@ const juce::ParameterID tempoSyncParamID { "tempoSync", 1};
 const juce::ParameterID delayNoteLParamID { "delayNoteL", 1};
 const juce::ParameterID delayNoteRParamID { "delayNoteR", 1};
 const juce::ParameterID bypassParamID {"bypass", 1};
+const juce::ParameterID clearOnBypassParamID {"clearOnBypass", 1};
+const juce::ParameterID interpolationParamID {"interpolation", 1};
+const juce::ParameterID timeChangeParamID {"timeChange", 1};
+const juce::ParameterID saturationParamID {"saturation", 1};
+const juce::ParameterID oversamplingParamID {"oversampling", 1};
+const juce::ParameterID tapCountParamID {"tapCount", 1};
+const juce::ParameterID compactMemoryParamID {"compactMemory", 1};
+const juce::ParameterID longDelayParamID {"longDelay", 1};
+const juce::ParameterID longDelayTimeParamID {"longDelayTime", 1};
+
+// per-tap parameters of the multi-tap mode, tap is 0-based
+juce::ParameterID tapTimeParamID(int tap);
+juce::ParameterID tapNoteParamID(int tap);
+juce::ParameterID tapLevelParamID(int tap);
+juce::ParameterID tapPanParamID(int tap);
 
 class Parameters
 {
@@ -37,10 +55,19 @@ public:
     void prepareToPlay(double sampleRate) noexcept;
     void reset() noexcept;
     void smoothen() noexcept;
+
+    // The host sets the values a block ends on. Long blocks are processed in
+    // segments, and the smoothed parameters head for a point part of the way
+    // from the previous block's values to these, 0 < progress <= 1 at the end
+    // of the segment. Automation then comes out as a ramp rather than one
+    // step per block. Call after update(), before the segment's smoothen().
+    void updateSegment(float progress) noexcept;
     
     float gain = { 0.0f };
     static constexpr float minDelayTime = {5.0f};
     static constexpr float maxDelayTime = {5000.0f};
+    static constexpr float maxLongDelayTime = {600000.0f};
+    static constexpr float minOversamplingDrive = {6.0f};
     float delayTimeL = {0.0f};
     float delayTimeR = {0.0f};
     float mix = {1.0f};
@@ -56,56 +83,132 @@ public:
     float postWSGain = {0.0f};
     int delayNoteL = 0;
     int delayNoteR = 0;
+    int interpolation = Interpolation::hermite;
+    int timeChange = TimeChange::duck;
+    int saturation = Saturation::exact;
+    int oversampling = 0; // 2^oversampling, 0 while the drive is low
+    static constexpr int maxTaps = {8};
+    int tapCount = 0;
+    std::array<float, maxTaps> tapTime {};
+    std::array<int, maxTaps> tapNote {};
+    std::array<float, maxTaps> tapLevel {};
+    std::array<float, maxTaps> tapPan {};
     bool tempoSync = false;
     bool bypassed = false;
 
     juce::AudioParameterBool* bypassParam;
 
     auto getTempoSyncParam() const noexcept {return tempoSyncParam;}
+    float getTargetDelayTimeL() const noexcept {return targetDelayTimeL;}
+    float getTargetDelayTimeR() const noexcept {return targetDelayTimeR;}
+    bool getCompactMemory() const noexcept {return compactMemoryParam->get();}
+    bool getClearOnBypass() const noexcept {return clearOnBypassParam->get();}
+    bool getLongDelay() const noexcept {return longDelayParam->get();}
+
+    // Set by the processor once the long delay history is in place. Both
+    // delay times then follow the long delay time, without tempo sync.
+    void setLongDelayMode(bool enabled) noexcept {longDelayMode = enabled;}
+
+    // Holds the delay times to what the delay line has room for, in ms,
+    // while it grows. Call after update().
+    void setDelayTimeLimit(float limit) noexcept;
+    float getDelayTimeLimit() const noexcept {return delayTimeLimit;}
+
+    // Small-signal gain of one pass through the feedback path, as a
+    // magnitude, from the parameter values rather than the smoothed ones. 1
+    // or more can ring on forever.
+    float getLoopGain() const noexcept;
 
 private:
+    // A smoothed value whose target moves across the host block, from where
+    // the previous block ended to where this one does.
+    struct Smoother : juce::LinearSmoothedValue<float>
+    {
+        void setBlockTarget(float blockTarget) noexcept
+        {
+            blockStart = blockEnd;
+            blockEnd = blockTarget;
+        }
+
+        void setSegmentTarget(float progress) noexcept
+        {
+            setTargetValue(blockStart + (blockEnd - blockStart) * progress);
+        }
+
+        void setCurrentAndTargetValue(float value) noexcept
+        {
+            blockStart = blockEnd = value;
+            juce::LinearSmoothedValue<float>::setCurrentAndTargetValue(value);
+        }
+
+        float blockStart = 0.0f;
+        float blockEnd = 0.0f;
+    };
+
     juce::AudioParameterFloat* gainParam = { nullptr };
-    juce::LinearSmoothedValue<float> gainSmoother = { 0.0f };
+    Smoother gainSmoother;
 
     juce::AudioParameterFloat* delayTimeLParam = { nullptr };
     float targetDelayTimeL = {0.0f};
-    float coeffL = {0.0f}; // one-pole smoothing
 
     juce::AudioParameterFloat* delayTimeRParam = { nullptr };
     float targetDelayTimeR = {0.0f};
-    float coeffR = {0.0f}; // one-pole smoothing
 
     juce::AudioParameterFloat* mixParam = { nullptr };
-    juce::LinearSmoothedValue<float> mixSmoother = { 0.0f };
+    Smoother mixSmoother;
 
     juce::AudioParameterFloat* feedbackParam = { nullptr };
-    juce::LinearSmoothedValue<float> feedbackSmoother = { 0.0f };
+    Smoother feedbackSmoother;
 
     juce::AudioParameterFloat* stereoParam = { nullptr };
-    juce::LinearSmoothedValue<float> stereoSmoother = { 0.0f };
+    Smoother stereoSmoother;
 
     juce::AudioParameterFloat* lowCutParam = { nullptr };
-    juce::LinearSmoothedValue<float> lowCutSmoother = { 0.0f };
+    Smoother lowCutSmoother;
 
     juce::AudioParameterFloat* highCutParam = { nullptr };
-    juce::LinearSmoothedValue<float> highCutSmoother = { 0.0f };
+    Smoother highCutSmoother;
 
     juce::AudioParameterFloat* lowCutQParam = { nullptr };
-    juce::LinearSmoothedValue<float> lowCutQSmoother = { 0.0f };
+    Smoother lowCutQSmoother;
 
     juce::AudioParameterFloat* highCutQParam = { nullptr };
-    juce::LinearSmoothedValue<float> highCutQSmoother = { 0.0f };
+    Smoother highCutQSmoother;
 
     juce::AudioParameterFloat* driveParam = { nullptr };
-    juce::LinearSmoothedValue<float> driveSmoother = { 0.0f };
+    Smoother driveSmoother;
 
     juce::AudioParameterFloat* postWSGainParam = { nullptr };
-    juce::LinearSmoothedValue<float> postWSGainSmoother = { 0.0f };
+    Smoother postWSGainSmoother;
     
     juce::AudioParameterChoice* delayNoteLParam = { nullptr };
     juce::AudioParameterChoice* delayNoteRParam = { nullptr };
 
     juce::AudioParameterBool* tempoSyncParam = { nullptr };
 
+    juce::AudioParameterChoice* interpolationParam = { nullptr };
+
+    juce::AudioParameterChoice* timeChangeParam = { nullptr };
+
+    juce::AudioParameterChoice* saturationParam = { nullptr };
+
+    juce::AudioParameterChoice* oversamplingParam = { nullptr };
+
+    juce::AudioParameterBool* compactMemoryParam = { nullptr };
+
+    juce::AudioParameterBool* clearOnBypassParam = { nullptr };
+
+    juce::AudioParameterBool* longDelayParam = { nullptr };
+    juce::AudioParameterFloat* longDelayTimeParam = { nullptr };
+    bool longDelayMode = false;
+
+    float delayTimeLimit = {maxDelayTime};
+
+    juce::AudioParameterInt* tapCountParam = { nullptr };
+    std::array<juce::AudioParameterFloat*, maxTaps> tapTimeParams {};
+    std::array<juce::AudioParameterChoice*, maxTaps> tapNoteParams {};
+    std::array<juce::AudioParameterFloat*, maxTaps> tapLevelParams {};
+    std::array<juce::AudioParameterFloat*, maxTaps> tapPanParams {};
+
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(Parameters)
 };
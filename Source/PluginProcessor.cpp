@@ -20,15 +20,25 @@ DelayAudioProcessor::DelayAudioProcessor()
                        ),
     params(apvts)
 {
-    lowCutFilter.setType(juce::dsp::StateVariableTPTFilterType::highpass);
-    highCutFilter.setType(juce::dsp::StateVariableTPTFilterType::lowpass);
-    distortionWaveShaper.functionToUse = [] (float x) {
-        return std::tanh(x);
-    };
+    lowCutFilter.setType(StateVariableFilter::Type::highpass);
+    highCutFilter.setType(StateVariableFilter::Type::lowpass);
+
+    // built here rather than on the audio thread
+    Interpolation::Sinc::getTable();
+    StateVariableFilter::getTable();
+    Saturation::Table::getValues();
+
+    DelayBufferPool::getInstance().addUser();
+
+    startTimer(tailUpdateInterval);
 }
 
 DelayAudioProcessor::~DelayAudioProcessor()
 {
+    stopTimer();
+
+    // the delay memory of the last instance goes back to the system
+    DelayBufferPool::getInstance().removeUser();
 }
 
 //==============================================================================
@@ -37,6 +47,11 @@ const juce::String DelayAudioProcessor::getName() const
     return JucePlugin_Name;
 }
 
+bool DelayAudioProcessor::supportsDoublePrecisionProcessing() const
+{
+    return true;
+}
+
 bool DelayAudioProcessor::acceptsMidi() const
 {
    #if JucePlugin_WantsMidiInput
@@ -66,7 +81,7 @@ bool DelayAudioProcessor::isMidiEffect() const
 
 double DelayAudioProcessor::getTailLengthSeconds() const
 {
-    return 0.0;
+    return publishedTailLength.load(std::memory_order_relaxed);
 }
 
 int DelayAudioProcessor::getNumPrograms()
@@ -99,72 +114,90 @@ void DelayAudioProcessor::prepareToPlay (double sampleRate, int samplesPerBlock)
     params.prepareToPlay(sampleRate);
     params.reset();
 
-    juce::dsp::ProcessSpec spec;
-    spec.sampleRate = sampleRate;
-    spec.maximumBlockSize = static_cast<juce::uint32>(samplesPerBlock);
-    spec.numChannels = 2;
+    // The long delay mode keeps its history in a file. When that cannot be
+    // set up, the plugin stays a regular delay.
+    bool longDelay = false;
+    if (params.getLongDelay())
+    {
+        double numLongSamples = Parameters::maxLongDelayTime / 1000.0 * sampleRate;
+        longDelay = longDelayLine.prepare(static_cast<int>(std::ceil(numLongSamples)));
+    }
+    else
+    {
+        longDelayLine.release();
+    }
+    params.setLongDelayMode(longDelay);
+
+    tempo.reset();
+
+    // Sized for the current settings, the resizer grows it when longer delay
+    // times come in.
+    params.update();
+    double numSamples = getLongestDelayTime() / 1000.0 * sampleRate;
+    int maxDelayInSamples = std::max(1, static_cast<int>(std::ceil(numSamples)));
+    auto storage = params.getCompactMemory() ? StereoDelayLine::Storage::compact : StereoDelayLine::Storage::full;
+    delayLineResizer.stop();
+    delayLine.setMaximumDelayInSamples(maxDelayInSamples, storage);
+    delayLine.reset();
+    delayLineResizer.start();
+
+    scratch.setSize(numScratchChannels, samplesPerBlock);
 
-    double numSamples = Parameters::maxDelayTime / 1000.0 * sampleRate;
-    int maxDelayInSamples = static_cast<int>(std::ceil(numSamples));
-    delayLineL.setMaximumDelayInSamples(maxDelayInSamples);
-    delayLineR.setMaximumDelayInSamples(maxDelayInSamples);
-    delayLineL.reset();
-    delayLineR.reset();
+    multiTap.prepareToPlay(sampleRate, samplesPerBlock);
+    multiTap.reset();
+
+    interpolationL = {};
+    interpolationR = {};
+    xfadeInterpolationL = {};
+    xfadeInterpolationR = {};
 
     feedbackL = 0.0f;
     feedbackR = 0.0f;
 
-    lowCutFilter.prepare(spec);
+    lowCutFilter.prepare(sampleRate);
     lowCutFilter.reset();
-    lastLowCut = -1.0f;
-    lastLowCutQ = -1.0f;
 
-    highCutFilter.prepare(spec);
+    highCutFilter.prepare(sampleRate);
     highCutFilter.reset();
-    lastHighCut = -1.0f;
-    lastHighCutQ = -1.0f;
-
-    distortionWaveShaper.prepare(spec);
-    distortionWaveShaper.reset();
 
-    tempo.reset();
+    for (auto& oversampler : oversamplers)
+    {
+        oversampler.prepare(samplesPerBlock);
+        oversampler.reset();
+    }
+    oversampling = params.oversampling;
+    previousOversampling = -1;
 
     levelL.reset();
     levelR.reset();
+    peakL = 0.0f;
+    peakR = 0.0f;
 
-#if CROSSFADE
-    delayInSamplesL = 0.0f;
-    delayInSamplesR = 0.0f;
-    targetDelayL = 0.0f;
-    targetDelayR = 0.0f;
-    xfadeL = 0.0f;
-    xfadeR = 0.0f;
-    xfadeInc = static_cast<float>(1.0 / (0.05 * sampleRate)); // 50 ms
-#endif
-#if DUCKING
-    delayInSamplesL = 0.0f;
-    delayInSamplesR = 0.0f;
-
-    fadeL = 1.0f;
-    fadeTargetL = 1.0f;
-    waitL = 0.0f;
+    chunkPosition = 0;
+    interpolation = params.interpolation;
+    isInputStereo = getTotalNumInputChannels() > 1;
+    isOutputStereo = getTotalNumOutputChannels() > 1;
 
-    fadeR = 1.0f;
-    fadeTargetR = 1.0f;
-    waitR = 0.0f;
+    timeChangeL.reset();
+    timeChangeR.reset();
+    timeChangeCoefficients.prepare(sampleRate);
+    lastTimeChange = -1;
 
-    waitInc = 1.0f / (0.3f * static_cast<float>(sampleRate)); // 300 ms
-    coeff = 1.0f - std::exp(-1.0f / (0.05f * static_cast<float>(sampleRate))); // 50 ms to 63.2%
-#endif
     lastBypass = false;
     bypassXfade = 0.0f;
     bypassXfadeInc = static_cast<float>(1.0 / (0.05 * sampleRate)); // 50 ms
+    fullyBypassed = false;
+
+    silence.reset();
 }
 
 void DelayAudioProcessor::releaseResources()
 {
     // When playback stops, you can use this as an opportunity to free up any
     // spare memory, etc.
+    longDelayLine.release();
+    params.setLongDelayMode(false);
+    delayLineResizer.stop();
 }
 
 #ifndef JucePlugin_PreferredChannelConfigurations
@@ -186,6 +219,17 @@ bool DelayAudioProcessor::isBusesLayoutSupported (const BusesLayout& layouts) co
 #endif
 
 void DelayAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, [[maybe_unused]] juce::MidiBuffer& midiMessages)
+{
+    processBuffer(buffer);
+}
+
+void DelayAudioProcessor::processBlock (juce::AudioBuffer<double>& buffer, [[maybe_unused]] juce::MidiBuffer& midiMessages)
+{
+    processBuffer(buffer);
+}
+
+template <typename SampleType>
+void DelayAudioProcessor::processBuffer(juce::AudioBuffer<SampleType>& buffer) noexcept
 {
     juce::ScopedNoDenormals noDenormals;
     auto totalNumInputChannels  = getTotalNumInputChannels();
@@ -196,225 +240,272 @@ void DelayAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, [[mayb
         buffer.clear (i, 0, buffer.getNumSamples());
     }
 
-    params.update();
-    tempo.update(getPlayHead());
-
-    float syncedTimeL = static_cast<float>(tempo.getMillisecondsForNoteLength(params.delayNoteL));
-    syncedTimeL = std::min(syncedTimeL, Parameters::maxDelayTime);
-    float syncedTimeR = static_cast<float>(tempo.getMillisecondsForNoteLength(params.delayNoteR));
-    syncedTimeR = std::min(syncedTimeR, Parameters::maxDelayTime);
-
-    float sampleRate = static_cast<float>(getSampleRate());
-
-    auto mainInput = getBusBuffer(buffer, true, 0);
-    auto mainInputChannels = mainInput.getNumChannels();
-    auto isMainInputStereo = mainInputChannels > 1;
-    const float* inputDataL = mainInput.getReadPointer(0);
-    const float* inputDataR = mainInput.getReadPointer(isMainInputStereo ? 1 : 0);
-    
-    auto mainOutput = getBusBuffer(buffer, false, 0);
-    auto mainOutputChannels = mainOutput.getNumChannels();
-    auto isMainOutputStereo = mainOutputChannels > 1;
-    float* outputDataL = mainOutput.getWritePointer(0);
-    float* outputDataR = mainOutput.getWritePointer(isMainOutputStereo ? 1 : 0);
+    // Blocks that reach the next chunk boundary pick up the settings, at the
+    // start of the block. Slivers that stay within the current chunk carry on
+    // with the settings of the last update.
+    int numSamples = buffer.getNumSamples();
+    int untilChunk = (chunkSize - chunkPosition) % chunkSize;
+    chunkPosition = (chunkPosition + numSamples) % chunkSize;
 
-    float maxL = 0.0f;
-    float maxR = 0.0f;
-    
-    if (isMainInputStereo)
+    if (untilChunk >= numSamples)
     {
-        for (auto sample = 0; sample < buffer.getNumSamples(); ++sample)
+        if (fullyBypassed)
         {
-            params.smoothen();
+            processBypassed(buffer);
+        }
+        else
+        {
+            processSegment(buffer);
+        }
+        return;
+    }
 
-#if CROSSFADE
-            if (xfadeL == 0.0f)
-            {
-                float delayTimeL = params.tempoSync ? syncedTimeL : params.delayTimeL;
-                targetDelayL = delayTimeL / 1000.0f * sampleRate;
+    // the settings hold until the first chunk boundary after this block
+    updateAndProcess(buffer, numSamples + (chunkSize - chunkPosition) % chunkSize, untilChunk);
 
-                if (delayInSamplesL == 0.0f)
-                {
-                    delayInSamplesL = targetDelayL;
-                }
-                else if (targetDelayL != delayInSamplesL)
-                {
-                    xfadeL = xfadeInc;
-                }
-            }
+    levelL.updateIfGreater(peakL);
+    levelR.updateIfGreater(peakR);
+    peakL = 0.0f;
+    peakR = 0.0f;
+}
 
-            if (xfadeR == 0.0f)
-            {
-                float delayTimeR = params.tempoSync ? syncedTimeR : params.delayTimeR;
-                targetDelayR = delayTimeR / 1000.0f * sampleRate;
+template <typename SampleType>
+void DelayAudioProcessor::updateAndProcess(juce::AudioBuffer<SampleType>& buffer, int numSamplesToNextUpdate,
+                                           int firstSegment) noexcept
+{
+    params.update();
 
-                if (delayInSamplesR == 0.0f)
-                {
-                    delayInSamplesR = targetDelayR;
-                }
-                else if (targetDelayR != delayInSamplesR)
-                {
-                    xfadeR = xfadeInc;
-                }
-            }
-#elif DUCKING
-            float delayTimeL = params.tempoSync ? syncedTimeL : params.delayTimeL;
-            float newTargetDelayL = delayTimeL / 1000.0f * sampleRate;
+    // Once the bypass crossfade is over the input passes straight through and
+    // none of the DSP runs, until the plugin is switched back on.
+    if (params.bypassed && lastBypass && bypassXfade == 0.0f)
+    {
+        processBypassed(buffer);
+        return;
+    }
+    if (fullyBypassed)
+    {
+        resumeFromBypass();
+    }
 
-            if (newTargetDelayL != targetDelayL)
-            {
-                targetDelayL = newTargetDelayL;
+    tempo.update(getPlayHead());
 
-                if (delayInSamplesL == 0.0f)
-                {
-                    delayInSamplesL = targetDelayL;
-                }
-                else
-                {
-                    waitL = waitInc;
-                    fadeTargetL = 0.0f;
-                }
-            }
+    // The delay line grows in the background, until then the delay times are
+    // held to what fits.
+    float sampleRate = static_cast<float>(getSampleRate());
+    int maxDelayInSamples = static_cast<int>(std::ceil(getLongestDelayTime() / 1000.0f * sampleRate));
+    delayLineResizer.update(maxDelayInSamples, isNonRealtime());
+    params.setDelayTimeLimit(float(delayLine.getMaximumDelay() - 1) / sampleRate * 1000.0f);
+    updateTailLength();
+
+    // before the idle check, the slivers after an idle block still ramp
+    multiTap.update(params, tempo, numSamplesToNextUpdate);
+
+    // Silent input and nothing audible left in the delay: the output is
+    // silent too, none of the DSP has to run. It picks up where it left off
+    // with the first block that is not.
+    if (params.bypassed == lastBypass && bypassXfade == 0.0f
+        && silence.isIdle(getBusBuffer(buffer, true, 0), getDelayReach()))
+    {
+        buffer.clear();
+        return;
+    }
 
-            float delayTimeR = params.tempoSync ? syncedTimeR : params.delayTimeR;
-            float newTargetDelayR = delayTimeR / 1000.0f * sampleRate;
+    // A change of oversampling fades from the old path to the new one over
+    // the first segment, the new one starting from a clean state.
+    previousOversampling = -1;
+    if (params.oversampling != oversampling)
+    {
+        previousOversampling = oversampling;
+        oversampling = params.oversampling;
+        activeOversampler ^= 1;
+        oversamplers[activeOversampler].reset();
+    }
 
-            if (newTargetDelayR != targetDelayR)
-            {
-                targetDelayR = newTargetDelayR;
+    // Offline renders get the windowed sinc in place of the smooth
+    // interpolators, the others are kept for their sound.
+    interpolation = params.interpolation;
+    if (isNonRealtime() && (interpolation == Interpolation::hermite || interpolation == Interpolation::lagrange))
+    {
+        interpolation = Interpolation::sinc;
+    }
 
-                if (delayInSamplesR == 0.0f)
-                {
-                    delayInSamplesR = targetDelayR;
-                }
-                else
-                {
-                    waitR = waitInc;
-                    fadeTargetR = 0.0f;
-                }
-            }
-#else
-            float delayTimeL = params.tempoSync ? syncedTimeL : params.delayTimeL;
-            float delayInSamplesL = delayTimeL / 1000.0f * sampleRate;
+    // The host only gives the values the block ends on. Each segment heads
+    // for its share of the way there, and runs with those targets.
+    int numSamples = buffer.getNumSamples();
+    int length = firstSegment > 0 ? firstSegment : chunkSize;
+    for (int start = 0; start < numSamples; start += length, length = chunkSize)
+    {
+        length = std::min(length, numSamples - start);
+        juce::AudioBuffer<SampleType> segment(buffer.getArrayOfWritePointers(), buffer.getNumChannels(), start, length);
+        params.updateSegment(float(start + length) / float(numSamples));
 
-            float delayTimeR = params.tempoSync ? syncedTimeR : params.delayTimeR;
-            float delayInSamplesR = delayTimeR / 1000.0f * sampleRate; 
-#endif
+        processSegment(segment);
+        previousOversampling = -1;
+    }
+}
 
-            if (params.lowCut != lastLowCut)
-            {
-                lowCutFilter.setCutoffFrequency(params.lowCut);
-                lastLowCut = params.lowCut;
-            }
+template <typename SampleType>
+void DelayAudioProcessor::processSegment(juce::AudioBuffer<SampleType>& segment) noexcept
+{
+    switch (interpolation)
+    {
+        case Interpolation::nearest: processBlockWith<Interpolation::Nearest>(segment); break;
+        case Interpolation::linear: processBlockWith<Interpolation::Linear>(segment); break;
+        case Interpolation::lagrange: processBlockWith<Interpolation::Lagrange>(segment); break;
+        case Interpolation::thiran: processBlockWith<Interpolation::Thiran>(segment); break;
+        case Interpolation::sinc: processBlockWith<Interpolation::Sinc>(segment); break;
+        default: processBlockWith<Interpolation::Hermite>(segment); break;
+    }
+}
 
-            if (params.lowCutQ != lastLowCutQ)
-            {
-                lowCutFilter.setResonance(params.lowCutQ);
-                lastLowCutQ = params.lowCutQ;
-            }
+template <typename Interpolator, typename SampleType>
+void DelayAudioProcessor::processBlockWith(juce::AudioBuffer<SampleType>& buffer) noexcept
+{
+    // switching strategies mid-transition restarts it the new way
+    if (params.timeChange != lastTimeChange)
+    {
+        timeChangeL.handOver();
+        timeChangeR.handOver();
+        lastTimeChange = params.timeChange;
+    }
 
-            if (params.highCut != lastHighCut)
-            {
-                highCutFilter.setCutoffFrequency(params.highCut);
-                lastHighCut = params.highCut;
-            }
+    switch (params.timeChange)
+    {
+        case TimeChange::glide: processBlockWith<Interpolator, TimeChange::Glide>(buffer); break;
+        case TimeChange::crossfade: processBlockWith<Interpolator, TimeChange::Crossfade>(buffer); break;
+        default: processBlockWith<Interpolator, TimeChange::Duck>(buffer); break;
+    }
+}
 
-            if (params.highCutQ != lastHighCutQ)
-            {
-                highCutFilter.setResonance(params.highCutQ);
-                lastHighCutQ = params.highCutQ;
-            }
-            
-            float dryL = inputDataL[sample];
-            float dryR = inputDataR[sample];
+template <typename Interpolator, typename Strategy, typename SampleType>
+void DelayAudioProcessor::processBlockWith(juce::AudioBuffer<SampleType>& buffer) noexcept
+{
+    float syncedTimeL = static_cast<float>(tempo.getMillisecondsForNoteLength(params.delayNoteL));
+    syncedTimeL = std::min(syncedTimeL, params.getDelayTimeLimit());
+    float syncedTimeR = static_cast<float>(tempo.getMillisecondsForNoteLength(params.delayNoteR));
+    syncedTimeR = std::min(syncedTimeR, params.getDelayTimeLimit());
+
+    float sampleRate = static_cast<float>(getSampleRate());
 
-            float mono = (dryL + dryR) * 0.5f;
+    // the main buses start at channel 0
+    const SampleType* inputDataL = buffer.getReadPointer(0);
+    const SampleType* inputDataR = buffer.getReadPointer(isInputStereo ? 1 : 0);
+    SampleType* outputDataL = buffer.getWritePointer(0);
+    SampleType* outputDataR = buffer.getWritePointer(isOutputStereo ? 1 : 0);
 
-            delayLineL.write(mono*params.panL + feedbackR);
-            delayLineR.write(mono*params.panR + feedbackL);
+    float maxL = 0.0f;
+    float maxR = 0.0f;
+    float writtenPeak = 0.0f;
+    
+    Interpolation::State* states[] = { &interpolationL, &interpolationR, &xfadeInterpolationL, &xfadeInterpolationR };
 
-            float wetL = delayLineL.read(delayInSamplesL);
-            float wetR = delayLineR.read(delayInSamplesR);
+    if (longDelayLine.isPrepared())
+    {
+        // The long delays always reach past the block, only the scratch size
+        // limits how much is processed in one go. Mono in reads L twice.
+        longDelayLine.setNonRealtime(isNonRealtime());
 
-#if CROSSFADE
-            if (xfadeL > 0.0f)
-            {
-                float newL = delayLineL.read(targetDelayL);
+        for (int start = 0; start < buffer.getNumSamples(); start += scratch.getNumSamples())
+        {
+            int numSamples = std::min(scratch.getNumSamples(), buffer.getNumSamples() - start);
+            processStaged<Interpolator, Strategy>(longDelayLine, inputDataL + start, inputDataR + start,
+                                                  outputDataL + start, outputDataR + start, numSamples,
+                                                  syncedTimeL, syncedTimeR, sampleRate, maxL, maxR);
+        }
+    }
+    else if (isInputStereo && canProcessStaged<Interpolator>(buffer.getNumSamples(), syncedTimeL, syncedTimeR, sampleRate))
+    {
+        processStaged<Interpolator, Strategy>(delayLine, inputDataL, inputDataR, outputDataL, outputDataR, buffer.getNumSamples(),
+                                              syncedTimeL, syncedTimeR, sampleRate, maxL, maxR);
+    }
+    else if (isInputStereo)
+    {
+        // the targets only change between blocks, steady channels stay steady
+        setTimeChangeTargets<Strategy>(syncedTimeL, syncedTimeR, sampleRate);
+        bool steady = timeChangeL.isSteady() && timeChangeR.isSteady();
 
-                wetL = (1.0f - xfadeL) * wetL + xfadeL * newL;
+        for (auto sample = 0; sample < buffer.getNumSamples(); ++sample)
+        {
+            params.smoothen();
 
-                xfadeL += xfadeInc;
-                if (xfadeL >= 1.0f)
-                {
-                    delayInSamplesL = targetDelayL;
-                    xfadeL = 0.0f;
-                }
+            if (!steady)
+            {
+                Strategy::beforeRead(timeChangeL, timeChangeCoefficients);
+                Strategy::beforeRead(timeChangeR, timeChangeCoefficients);
             }
 
-            if (xfadeR > 0.0f)
-            {
-                float newR = delayLineR.read(targetDelayR);
+            lowCutFilter.setParameters(params.lowCut, params.lowCutQ);
+            highCutFilter.setParameters(params.highCut, params.highCutQ);
 
-                wetR = (1.0f - xfadeR) * wetR + xfadeR * newR;
+            SampleType dryL = inputDataL[sample];
+            SampleType dryR = inputDataR[sample];
 
-                xfadeR += xfadeInc;
-                if (xfadeR >= 1.0f)
-                {
-                    delayInSamplesR = targetDelayR;
-                    xfadeR = 0.0f;
-                }
-            }
-#endif
-#if DUCKING
-            fadeL += (fadeTargetL - fadeL) * coeff;
+            float mono = float((dryL + dryR) * 0.5f);
 
-            wetL *= fadeL;
+            float writeL = mono*params.panL + feedbackR;
+            float writeR = mono*params.panR + feedbackL;
+            delayLine.write(writeL, writeR);
+            writtenPeak = std::max(writtenPeak, std::max(std::abs(writeL), std::abs(writeR)));
 
-            if (waitL > 0.0f)
+            // L and R, plus the crossfade taps when needed, are read together
+            float delays[] = { timeChangeL.delay, timeChangeR.delay, 0.0f, 0.0f };
+            int numLanes = 2;
+            if constexpr (Strategy::crossfades)
             {
-                waitL += waitInc;
-                if (waitL >= 1.0f)
+                if (!steady && (timeChangeL.xfade > 0.0f || timeChangeR.xfade > 0.0f))
                 {
-                    delayInSamplesL = targetDelayL;
-                    waitL = 0.0f;
-                    fadeTargetL = 1.0f; // fade in
+                    delays[2] = timeChangeL.getNewDelay();
+                    delays[3] = timeChangeR.getNewDelay();
+                    numLanes = 4;
                 }
             }
+            float wet[4];
+            delayLine.readLanes<Interpolator>(delays, states, wet, numLanes);
 
-            fadeR += (fadeTargetR - fadeR) * coeff;
-
-            wetR *= fadeR;
+            float wetL = wet[0];
+            float wetR = wet[1];
 
-            if (waitR > 0.0f)
+            if (!steady)
             {
-                waitR += waitInc;
-                if (waitR >= 1.0f)
+                if constexpr (Strategy::crossfades)
+                {
+                    if (timeChangeL.xfade > 0.0f)
+                    {
+                        wetL = (1.0f - timeChangeL.xfade) * wetL + timeChangeL.xfade * wet[2];
+                    }
+                    if (timeChangeR.xfade > 0.0f)
+                    {
+                        wetR = (1.0f - timeChangeR.xfade) * wetR + timeChangeR.xfade * wet[3];
+                    }
+                }
+                if constexpr (Strategy::ducks)
                 {
-                    delayInSamplesR = targetDelayR;
-                    waitR = 0.0f;
-                    fadeTargetR = 1.0f; // fade in
+                    wetL *= timeChangeL.fade;
+                    wetR *= timeChangeR.fade;
                 }
+
+                Strategy::afterRead(timeChangeL, timeChangeCoefficients);
+                Strategy::afterRead(timeChangeR, timeChangeCoefficients);
             }
-#endif
 
             feedbackL = wetL * params.feedback;
-            feedbackL = lowCutFilter.processSample(0, feedbackL);
-            feedbackL = distortionWaveShaper.processSample(params.drive * feedbackL) * params.postWSGain;
-            feedbackL = highCutFilter.processSample(0, feedbackL);
-
             feedbackR = wetR * params.feedback;
-            feedbackR = lowCutFilter.processSample(1, feedbackR);
-            feedbackR = distortionWaveShaper.processSample(params.drive * feedbackR) * params.postWSGain;
-            feedbackR = highCutFilter.processSample(1, feedbackR);
+            lowCutFilter.processStereo(feedbackL, feedbackR);
+            float previousL, previousR;
+            saturateFeedback(&feedbackL, &feedbackR, &params.drive, &params.postWSGain, 1,
+                             &previousL, &previousR, sample, buffer.getNumSamples());
+            highCutFilter.processStereo(feedbackL, feedbackR);
+
+            multiTap.processSample<Interpolator>(delayLine, wetL, wetR);
 
-            float mixL = (1.0f - params.mix) * dryL + wetL * params.mix;
-            float mixR = (1.0f - params.mix) * dryR + wetR * params.mix;
+            SampleType mixL = (1.0f - params.mix) * dryL + wetL * params.mix;
+            SampleType mixR = (1.0f - params.mix) * dryR + wetR * params.mix;
 
-            float postGainL = mixL * params.gain;
-            float postGainR = mixR * params.gain;
+            SampleType postGainL = mixL * params.gain;
+            SampleType postGainR = mixR * params.gain;
 
-            float outL = postGainL;
-            float outR = postGainR;
+            SampleType outL = postGainL;
+            SampleType outR = postGainR;
 
             if (params.bypassed != lastBypass)
             {
@@ -459,9 +550,11 @@ void DelayAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, [[mayb
             outputDataL[sample] = outL;
             outputDataR[sample] = outR;
 
-            maxL = std::max(maxL, std::abs(outL));
-            maxR = std::max(maxR, std::abs(outR));
+            maxL = std::max(maxL, float(std::abs(outL)));
+            maxR = std::max(maxR, float(std::abs(outR)));
         }
+
+        silence.written(writtenPeak, buffer.getNumSamples());
     }
     else
     {
@@ -471,16 +564,20 @@ void DelayAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, [[mayb
 
             float delayInSamples = params.delayTimeL / 1000.0f * sampleRate;
             
-            float dry = inputDataL[sample];
-            delayLineL.write(dry + feedbackL);
+            SampleType dry = inputDataL[sample];
+            float write = float(dry) + feedbackL;
+            delayLine.write(write, 0.0f);
+            writtenPeak = std::max(writtenPeak, std::abs(write));
 
-            float wet = delayLineL.read(delayInSamples);
+            float wet = delayLine.read<Interpolator>(0, delayInSamples, interpolationL);
             feedbackL = wet * params.feedback;
 
-            float mix = (1.0f - params.mix) * dry + wet * params.mix;
+            multiTap.processSample<Interpolator>(delayLine, wet);
+
+            SampleType mix = (1.0f - params.mix) * dry + wet * params.mix;
 
-            float postGain = mix * params.gain;
-            float out = postGain;
+            SampleType postGain = mix * params.gain;
+            SampleType out = postGain;
 
             if (params.bypassed != lastBypass)
             {
@@ -520,19 +617,466 @@ void DelayAudioProcessor::processBlock (juce::AudioBuffer<float>& buffer, [[mayb
             }
 
             outputDataL[sample] = out;
-            maxL = std::max(maxL, std::abs(out));
-            maxR = std::max(maxL, std::abs(out));
+            maxL = std::max(maxL, float(std::abs(out)));
+            maxR = std::max(maxL, float(std::abs(out)));
         }
+
+        silence.written(writtenPeak, buffer.getNumSamples());
     }
 
-    levelL.updateIfGreater(maxL);
-    levelR.updateIfGreater(maxR);
+    peakL = std::max(peakL, maxL);
+    peakR = std::max(peakR, maxR);
 
 #if JUCE_DEBUG
     protectYourEars(buffer);
 #endif
 }
 
+void DelayAudioProcessor::updateTailLength() noexcept
+{
+    float delayTime = params.tempoSync
+        ? static_cast<float>(std::max(tempo.getMillisecondsForNoteLength(params.delayNoteL),
+                                      tempo.getMillisecondsForNoteLength(params.delayNoteR)))
+        : std::max(params.getTargetDelayTimeL(), params.getTargetDelayTimeR());
+    delayTime = std::min(delayTime, longDelayLine.isPrepared() ? Parameters::maxLongDelayTime : params.getDelayTimeLimit());
+
+    // the taps are not used in the long delay mode
+    float tapTime = 0.0f;
+    size_t numTaps = longDelayLine.isPrepared() ? 0 : static_cast<size_t>(params.tapCount);
+    for (size_t tap = 0; tap < numTaps; ++tap)
+    {
+        tapTime = std::max(tapTime, params.tempoSync ? static_cast<float>(tempo.getMillisecondsForNoteLength(params.tapNote[tap]))
+                                                     : params.tapTime[tap]);
+    }
+
+    // Every pass through the feedback path scales the echoes by the loop
+    // gain. They are gone once it has taken a full scale input below the
+    // silence threshold, the first echo and the taps come on top.
+    double seconds = std::numeric_limits<double>::infinity();
+    float loopGain = params.getLoopGain();
+    if (loopGain < 1.0f)
+    {
+        double numPasses = loopGain > 0.0f ? std::ceil(std::log(SilenceDetector::threshold) / std::log(loopGain)) : 0.0;
+        seconds = (numPasses * delayTime + std::max(delayTime, tapTime)) / 1000.0;
+    }
+
+    tailLength.store(seconds, std::memory_order_relaxed);
+}
+
+void DelayAudioProcessor::timerCallback()
+{
+    // only changes the host would notice, not every step of an automation
+    double seconds = tailLength.load(std::memory_order_relaxed);
+    double published = publishedTailLength.load(std::memory_order_relaxed);
+    bool changed = std::isinf(seconds) || std::isinf(published) ? seconds != published
+                                                                : std::abs(seconds - published) > 0.01 * published;
+    if (!changed)
+    {
+        return;
+    }
+
+    publishedTailLength.store(seconds, std::memory_order_relaxed);
+
+    // Not a latency or program change, some hosts restart the plugin for
+    // those and that would clear the delay.
+    updateHostDisplay(ChangeDetails().withNonParameterStateChanged(true));
+}
+
+int DelayAudioProcessor::getDelayReach() const noexcept
+{
+    // Anything in the delay line could be read. The long delay history only
+    // matters as far back as the delays in use reach.
+    if (!longDelayLine.isPrepared())
+    {
+        return delayLine.getBufferLength();
+    }
+
+    float longest = std::max({ timeChangeL.delay, timeChangeL.target, timeChangeL.next,
+                               timeChangeR.delay, timeChangeR.target, timeChangeR.next });
+    float sampleRate = static_cast<float>(getSampleRate());
+    longest = std::max(longest, std::max(params.getTargetDelayTimeL(), params.getTargetDelayTimeR()) / 1000.0f * sampleRate);
+    return static_cast<int>(std::ceil(longest)) + Interpolation::maxNumTaps / 2 + 1;
+}
+
+template <typename SampleType>
+void DelayAudioProcessor::processBypassed(juce::AudioBuffer<SampleType>& buffer) noexcept
+{
+    fullyBypassed = true;
+
+    // the output already holds the input, only the meters need it
+    int channelR = isInputStereo ? 1 : 0;
+    peakL = std::max(peakL, float(buffer.getMagnitude(0, 0, buffer.getNumSamples())));
+    peakR = std::max(peakR, float(buffer.getMagnitude(channelR, 0, buffer.getNumSamples())));
+}
+
+void DelayAudioProcessor::resumeFromBypass() noexcept
+{
+    fullyBypassed = false;
+
+    // Kept, the echoes carry on from where the bypass stopped them. Cleared,
+    // the delay starts from silence, like after prepareToPlay().
+    if (!params.getClearOnBypass())
+    {
+        return;
+    }
+
+    delayLine.reset();
+    if (longDelayLine.isPrepared())
+    {
+        longDelayLine.reset();
+    }
+    multiTap.reset();
+
+    interpolationL = {};
+    interpolationR = {};
+    xfadeInterpolationL = {};
+    xfadeInterpolationR = {};
+    timeChangeL.reset();
+    timeChangeR.reset();
+
+    feedbackL = 0.0f;
+    feedbackR = 0.0f;
+    lowCutFilter.reset();
+    highCutFilter.reset();
+    oversamplers[0].reset();
+    oversamplers[1].reset();
+
+    silence.reset();
+}
+
+void DelayAudioProcessor::saturate(int order, Oversampler& oversampler, float* left, float* right,
+                                   const float* drive, const float* gain, int numSamples) noexcept
+{
+    if (order == 0)
+    {
+        Saturation::processBlock(params.saturation, left, drive, gain, numSamples);
+        Saturation::processBlock(params.saturation, right, drive, gain, numSamples);
+        return;
+    }
+
+    // drive and gain are linear, they stay at the base rate
+    juce::FloatVectorOperations::multiply(left, drive, numSamples);
+    juce::FloatVectorOperations::multiply(right, drive, numSamples);
+    oversampler.processBlock(order, params.saturation, left, right, numSamples);
+    juce::FloatVectorOperations::multiply(left, gain, numSamples);
+    juce::FloatVectorOperations::multiply(right, gain, numSamples);
+}
+
+// The saturation of the feedback path, numSamples of it starting offset
+// samples into the block. While the oversampling changes, both paths run and
+// the block fades from the previous one, kept in previousL and previousR.
+void DelayAudioProcessor::saturateFeedback(float* left, float* right, const float* drive, const float* gain, int numSamples,
+                                           float* previousL, float* previousR, int offset, int blockSize) noexcept
+{
+    if (previousOversampling < 0)
+    {
+        saturate(oversampling, oversamplers[activeOversampler], left, right, drive, gain, numSamples);
+        return;
+    }
+
+    std::copy_n(left, numSamples, previousL);
+    std::copy_n(right, numSamples, previousR);
+    saturate(previousOversampling, oversamplers[activeOversampler ^ 1], previousL, previousR, drive, gain, numSamples);
+    saturate(oversampling, oversamplers[activeOversampler], left, right, drive, gain, numSamples);
+
+    float step = 1.0f / float(blockSize);
+    for (int sample = 0; sample < numSamples; ++sample)
+    {
+        float fade = float(offset + sample + 1) * step;
+        left[sample] = previousL[sample] + (left[sample] - previousL[sample]) * fade;
+        right[sample] = previousR[sample] + (right[sample] - previousR[sample]) * fade;
+    }
+}
+
+float DelayAudioProcessor::getLongestDelayTime() const noexcept
+{
+    float longest = 0.0f;
+
+    // the long delay mode does not use the delay line, and has no taps
+    if (!longDelayLine.isPrepared())
+    {
+        if (params.tempoSync)
+        {
+            longest = std::max(static_cast<float>(tempo.getMillisecondsForNoteLength(params.delayNoteL)),
+                               static_cast<float>(tempo.getMillisecondsForNoteLength(params.delayNoteR)));
+        }
+        else
+        {
+            longest = std::max(params.getTargetDelayTimeL(), params.getTargetDelayTimeR());
+        }
+
+        for (size_t tap = 0; tap < static_cast<size_t>(params.tapCount); ++tap)
+        {
+            float tapTime = params.tempoSync ? static_cast<float>(tempo.getMillisecondsForNoteLength(params.tapNote[tap]))
+                                             : params.tapTime[tap];
+            longest = std::max(longest, tapTime);
+        }
+    }
+
+    return std::min(longest, Parameters::maxDelayTime);
+}
+
+template <typename Strategy>
+void DelayAudioProcessor::setTimeChangeTargets(float syncedTimeL, float syncedTimeR, float sampleRate) noexcept
+{
+    float delayTimeL = params.tempoSync ? syncedTimeL : params.getTargetDelayTimeL();
+    Strategy::setTarget(timeChangeL, delayTimeL / 1000.0f * sampleRate, timeChangeCoefficients);
+
+    float delayTimeR = params.tempoSync ? syncedTimeR : params.getTargetDelayTimeR();
+    Strategy::setTarget(timeChangeR, delayTimeR / 1000.0f * sampleRate, timeChangeCoefficients);
+}
+
+template <typename Interpolator>
+bool DelayAudioProcessor::canProcessStaged(int numSamples, float syncedTimeL, float syncedTimeR, float sampleRate) const noexcept
+{
+    if (numSamples > scratch.getNumSamples())
+    {
+        return false;
+    }
+
+    // Every delay read in this block has to reach further back than the start
+    // of the block, then no sample depends on another sample of the same block.
+    float delayTimeL = params.tempoSync ? syncedTimeL : params.getTargetDelayTimeL();
+    float delayTimeR = params.tempoSync ? syncedTimeR : params.getTargetDelayTimeR();
+    float minDelay = std::min(delayTimeL / 1000.0f * sampleRate, delayTimeR / 1000.0f * sampleRate);
+
+    if (timeChangeL.delay != 0.0f)
+    {
+        minDelay = std::min(minDelay, timeChangeL.getShortestDelay());
+    }
+    if (timeChangeR.delay != 0.0f)
+    {
+        minDelay = std::min(minDelay, timeChangeR.getShortestDelay());
+    }
+
+    minDelay = std::min(minDelay, multiTap.getMinimumDelay());
+
+    // the newest tap of the first sample is written by the end of the block
+    return minDelay >= float(numSamples + Interpolator::numTaps / 2 - 1);
+}
+
+template <typename Interpolator, typename Strategy, typename Line, typename SampleType>
+void DelayAudioProcessor::processStaged(Line& line, const SampleType* inputDataL, const SampleType* inputDataR,
+                                        SampleType* outputDataL, SampleType* outputDataR, int numSamples,
+                                        float syncedTimeL, float syncedTimeR, float sampleRate,
+                                        float& maxL, float& maxR) noexcept
+{
+    float* delayL = scratch.getWritePointer(delayLChannel);
+    float* delayR = scratch.getWritePointer(delayRChannel);
+    float* wetL = scratch.getWritePointer(wetLChannel);
+    float* wetR = scratch.getWritePointer(wetRChannel);
+    float* fbL = scratch.getWritePointer(feedbackLChannel);
+    float* fbR = scratch.getWritePointer(feedbackRChannel);
+    float* writeL = scratch.getWritePointer(writeLChannel);
+    float* writeR = scratch.getWritePointer(writeRChannel);
+    float* panL = scratch.getWritePointer(panLChannel);
+    float* panR = scratch.getWritePointer(panRChannel);
+    float* feedback = scratch.getWritePointer(feedbackChannel);
+    float* drive = scratch.getWritePointer(driveChannel);
+    float* postWSGain = scratch.getWritePointer(postWSGainChannel);
+    float* lowCut = scratch.getWritePointer(lowCutChannel);
+    float* lowCutQ = scratch.getWritePointer(lowCutQChannel);
+    float* highCut = scratch.getWritePointer(highCutChannel);
+    float* highCutQ = scratch.getWritePointer(highCutQChannel);
+    float* mix = scratch.getWritePointer(mixChannel);
+    float* gain = scratch.getWritePointer(gainChannel);
+    float* newDelayL = scratch.getWritePointer(newDelayLChannel);
+    float* newDelayR = scratch.getWritePointer(newDelayRChannel);
+    float* xfadeAmountL = scratch.getWritePointer(xfadeLChannel);
+    float* xfadeAmountR = scratch.getWritePointer(xfadeRChannel);
+    float* fadeAmountL = scratch.getWritePointer(fadeLChannel);
+    float* fadeAmountR = scratch.getWritePointer(fadeRChannel);
+
+    // Stage 1: parameter smoothing and the delay times. This does not depend
+    // on the audio, so it runs ahead for the whole block. The delay targets
+    // are set once, only channels in transition step through the block.
+    setTimeChangeTargets<Strategy>(syncedTimeL, syncedTimeR, sampleRate);
+    bool movingL = TimeChange::render<Strategy>(timeChangeL, delayL, newDelayL, xfadeAmountL, fadeAmountL,
+                                                numSamples, timeChangeCoefficients);
+    bool movingR = TimeChange::render<Strategy>(timeChangeR, delayR, newDelayR, xfadeAmountR, fadeAmountR,
+                                                numSamples, timeChangeCoefficients);
+
+    for (int sample = 0; sample < numSamples; ++sample)
+    {
+        params.smoothen();
+
+        panL[sample] = params.panL;
+        panR[sample] = params.panR;
+        feedback[sample] = params.feedback;
+        drive[sample] = params.drive;
+        postWSGain[sample] = params.postWSGain;
+        lowCut[sample] = params.lowCut;
+        lowCutQ[sample] = params.lowCutQ;
+        highCut[sample] = params.highCut;
+        highCutQ[sample] = params.highCutQ;
+        mix[sample] = params.mix;
+        gain[sample] = params.gain;
+    }
+
+    // Stage 2: bulk read. Nothing of this block has been written yet, so every
+    // delay is shortened by the block length to address the same samples.
+    float blockLength = float(numSamples);
+    for (int sample = 0; sample < numSamples; ++sample)
+    {
+        delayL[sample] -= blockLength;
+        delayR[sample] -= blockLength;
+    }
+    line.template readBlock<Interpolator>(0, wetL, delayL, numSamples, interpolationL);
+    line.template readBlock<Interpolator>(1, wetR, delayR, numSamples, interpolationR);
+
+    if (Strategy::crossfades && (movingL || movingR))
+    {
+        float* newWetL = scratch.getWritePointer(newWetLChannel);
+        float* newWetR = scratch.getWritePointer(newWetRChannel);
+
+        // both channels are read together, a steady one reads its delay twice
+        if (!movingL)
+        {
+            juce::FloatVectorOperations::copy(newDelayL, delayL, numSamples);
+            juce::FloatVectorOperations::clear(xfadeAmountL, numSamples);
+        }
+        if (!movingR)
+        {
+            juce::FloatVectorOperations::copy(newDelayR, delayR, numSamples);
+            juce::FloatVectorOperations::clear(xfadeAmountR, numSamples);
+        }
+
+        for (int sample = 0; sample < numSamples; ++sample)
+        {
+            newDelayL[sample] -= blockLength;
+            newDelayR[sample] -= blockLength;
+        }
+        if constexpr (std::is_same_v<Line, LongDelayLine>)
+        {
+            // its own read-ahead, the delay it fades from still reads too
+            line.template readBlock<Interpolator>(0, newWetL, newDelayL, numSamples, xfadeInterpolationL, 1);
+            line.template readBlock<Interpolator>(1, newWetR, newDelayR, numSamples, xfadeInterpolationR, 1);
+        }
+        else
+        {
+            line.template readBlock<Interpolator>(0, newWetL, newDelayL, numSamples, xfadeInterpolationL);
+            line.template readBlock<Interpolator>(1, newWetR, newDelayR, numSamples, xfadeInterpolationR);
+        }
+
+        for (int sample = 0; sample < numSamples; ++sample)
+        {
+            if (xfadeAmountL[sample] > 0.0f)
+            {
+                wetL[sample] = (1.0f - xfadeAmountL[sample]) * wetL[sample] + xfadeAmountL[sample] * newWetL[sample];
+            }
+            if (xfadeAmountR[sample] > 0.0f)
+            {
+                wetR[sample] = (1.0f - xfadeAmountR[sample]) * wetR[sample] + xfadeAmountR[sample] * newWetR[sample];
+            }
+        }
+    }
+    if constexpr (Strategy::ducks)
+    {
+        if (movingL)
+        {
+            juce::FloatVectorOperations::multiply(wetL, fadeAmountL, numSamples);
+        }
+        if (movingR)
+        {
+            juce::FloatVectorOperations::multiply(wetR, fadeAmountR, numSamples);
+        }
+    }
+
+    // Stage 3: bulk feedback path, one processing step at a time.
+    juce::FloatVectorOperations::multiply(fbL, wetL, feedback, numSamples);
+    juce::FloatVectorOperations::multiply(fbR, wetR, feedback, numSamples);
+
+    lowCutFilter.processBlock(fbL, fbR, lowCut, lowCutQ, numSamples);
+
+    saturateFeedback(fbL, fbR, drive, postWSGain, numSamples,
+                     scratch.getWritePointer(saturationLChannel), scratch.getWritePointer(saturationRChannel),
+                     0, numSamples);
+
+    highCutFilter.processBlock(fbL, fbR, highCut, highCutQ, numSamples);
+
+    // The taps only add to the wet signal, after the feedback has been taken.
+    // They read the regular delay line, the long delay mode has none.
+    if constexpr (std::is_same_v<Line, StereoDelayLine>)
+    {
+        multiTap.processBlock<Interpolator>(line, wetL, wetR, numSamples);
+    }
+
+    // Stage 4: bulk write, each sample carries the feedback of the previous one.
+    for (int sample = 0; sample < numSamples; ++sample)
+    {
+        float mono = float((inputDataL[sample] + inputDataR[sample]) * 0.5f);
+        writeL[sample] = mono*panL[sample] + feedbackR;
+        writeR[sample] = mono*panR[sample] + feedbackL;
+        feedbackL = fbL[sample];
+        feedbackR = fbR[sample];
+    }
+    line.writeBlock(writeL, writeR, numSamples);
+    silence.written(std::max(SilenceDetector::getPeak(writeL, numSamples), SilenceDetector::getPeak(writeR, numSamples)),
+                    numSamples);
+
+    // Stage 5: mix, output gain and bypass.
+    for (int sample = 0; sample < numSamples; ++sample)
+    {
+        SampleType dryL = inputDataL[sample];
+        SampleType dryR = inputDataR[sample];
+
+        SampleType mixL = (1.0f - mix[sample]) * dryL + wetL[sample] * mix[sample];
+        SampleType mixR = (1.0f - mix[sample]) * dryR + wetR[sample] * mix[sample];
+
+        SampleType postGainL = mixL * gain[sample];
+        SampleType postGainR = mixR * gain[sample];
+
+        SampleType outL = postGainL;
+        SampleType outR = postGainR;
+
+        if (params.bypassed != lastBypass)
+        {
+            lastBypass = params.bypassed;
+            bypassXfade = bypassXfadeInc;
+        }
+
+        if (params.bypassed)
+        {
+            if (bypassXfade > 0.0f)
+            {
+                outL = (1.0f - bypassXfade) * postGainL + dryL * bypassXfade;
+                outR = (1.0f - bypassXfade) * postGainR + dryR * bypassXfade;
+
+                bypassXfade += bypassXfadeInc;
+                if (bypassXfade >= 1.0f)
+                {
+                    bypassXfade = 0.0f;
+                }
+            }
+            else
+            {
+                outL = dryL;
+                outR = dryR;
+            }
+        }
+        else
+        {
+            if (bypassXfade > 0.0f)
+            {
+                outL = (1.0f - bypassXfade) * dryL + postGainL * bypassXfade;
+                outR = (1.0f - bypassXfade) * dryR + postGainR * bypassXfade;
+
+                bypassXfade += bypassXfadeInc;
+                if (bypassXfade >= 1.0f)
+                {
+                    bypassXfade = 0.0f;
+                }
+            }
+        }
+
+        outputDataL[sample] = outL;
+        outputDataR[sample] = outR;
+
+        maxL = std::max(maxL, float(std::abs(outL)));
+        maxR = std::max(maxR, float(std::abs(outR)));
+    }
+}
+
 //==============================================================================
 bool DelayAudioProcessor::hasEditor() const
 {
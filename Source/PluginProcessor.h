@@ -1,16 +1,23 @@
 #pragma once
 
 #include <JuceHeader.h>
-#include "DelayLine.h"
+#include "StereoDelayLine.h"
+#include "DelayLineResizer.h"
+#include "LongDelayLine.h"
+#include "MultiTap.h"
 #include "Parameters.h"
 #include "Tempo.h"
 #include "Measurement.h"
-#include "Defines.h"
+#include "TimeChange.h"
+#include "SilenceDetector.h"
+#include "StateVariableFilter.h"
+#include "Oversampler.h"
 
 //==============================================================================
 /**
 */
-class DelayAudioProcessor  : public juce::AudioProcessor
+class DelayAudioProcessor  : public juce::AudioProcessor,
+                             private juce::Timer
 {
 public:
     //==============================================================================
@@ -26,6 +33,8 @@ public:
    #endif
 
     void processBlock (juce::AudioBuffer<float>&, juce::MidiBuffer&) override;
+    void processBlock (juce::AudioBuffer<double>&, juce::MidiBuffer&) override;
+    bool supportsDoublePrecisionProcessing() const override;
 
     //==============================================================================
     juce::AudioProcessorEditor* createEditor() override;
@@ -57,50 +66,136 @@ public:
     Measurement levelL, levelR;
 
 private:
+    // The audio is counted in chunks of this many samples, across host
+    // blocks. The per-block work runs once per chunk at most, and longer host
+    // blocks are split on the chunk boundaries, each segment with its own
+    // smoothing targets, so automation within them is followed.
+    static constexpr int chunkSize = 64;
+
+    // Both entry points run the same engine. The delay line and the feedback
+    // path are float either way, the dry signal and the output stay in the
+    // host's precision.
+    template <typename SampleType>
+    void processBuffer(juce::AudioBuffer<SampleType>& buffer) noexcept;
+    template <typename SampleType>
+    void updateAndProcess(juce::AudioBuffer<SampleType>& buffer, int numSamplesToNextUpdate, int firstSegment) noexcept;
+    template <typename SampleType>
+    void processSegment(juce::AudioBuffer<SampleType>& segment) noexcept;
+    template <typename Interpolator, typename SampleType>
+    void processBlockWith(juce::AudioBuffer<SampleType>& buffer) noexcept;
+    template <typename Interpolator, typename Strategy, typename SampleType>
+    void processBlockWith(juce::AudioBuffer<SampleType>& buffer) noexcept;
+    template <typename SampleType>
+    void processBypassed(juce::AudioBuffer<SampleType>& buffer) noexcept;
+    void resumeFromBypass() noexcept;
+    int getDelayReach() const noexcept;
+    void updateTailLength() noexcept;
+    void timerCallback() override;
+    float getLongestDelayTime() const noexcept;
+    void saturate(int order, Oversampler& oversampler, float* left, float* right,
+                  const float* drive, const float* gain, int numSamples) noexcept;
+    void saturateFeedback(float* left, float* right, const float* drive, const float* gain, int numSamples,
+                          float* previousL, float* previousR, int offset, int blockSize) noexcept;
+    template <typename Strategy>
+    void setTimeChangeTargets(float syncedTimeL, float syncedTimeR, float sampleRate) noexcept;
+    template <typename Interpolator>
+    bool canProcessStaged(int numSamples, float syncedTimeL, float syncedTimeR, float sampleRate) const noexcept;
+    template <typename Interpolator, typename Strategy, typename Line, typename SampleType>
+    void processStaged(Line& line, const SampleType* inputDataL, const SampleType* inputDataR,
+                       SampleType* outputDataL, SampleType* outputDataR, int numSamples,
+                       float syncedTimeL, float syncedTimeR, float sampleRate,
+                       float& maxL, float& maxR) noexcept;
+
     juce::AudioProcessorValueTreeState apvts { *this, nullptr, "Parameters", Parameters::createParameterLayout() };
     Parameters params;
-    DelayLine delayLineL, delayLineR;
+    StereoDelayLine delayLine;
+    DelayLineResizer delayLineResizer { delayLine };
+    LongDelayLine longDelayLine;
+    Interpolation::State interpolationL, interpolationR;
+    Interpolation::State xfadeInterpolationL, xfadeInterpolationR;
+    MultiTap multiTap;
     float feedbackL = 0.0f;
     float feedbackR = 0.0f;
-    juce::dsp::StateVariableTPTFilter<float> lowCutFilter;
-    juce::dsp::StateVariableTPTFilter<float> highCutFilter;
-    juce::dsp::WaveShaper<float> distortionWaveShaper;
-    float lastLowCut = -1.0f;
-    float lastHighCut = -1.0f;
-    float lastLowCutQ = -1.0f;
-    float lastHighCutQ = -1.0f;
+    StateVariableFilter lowCutFilter;
+    StateVariableFilter highCutFilter;
+
+    // Two, so a change of oversampling can fade from the old one to the new
+    // one. The order is 0 without oversampling, the previous one is -1
+    // unless it changed in this segment.
+    Oversampler oversamplers[2];
+    int activeOversampler = 0;
+    int oversampling = 0;
+    int previousOversampling = -1;
     Tempo tempo;
 
-#if CROSSFADE
-    float delayInSamplesL = 0.0f;
-    float delayInSamplesR = 0.0f;
-    float targetDelayL = 0.0f;
-    float targetDelayR = 0.0f;
-    float xfadeL = 0.0f;
-    float xfadeR = 0.0f;
-    float xfadeInc = 0.0f;
-#endif
-#if DUCKING
-    float delayInSamplesL = 0.0f;
-    float delayInSamplesR = 0.0f;
-    float targetDelayL = 0.0f;
-    float targetDelayR = 0.0f;
-
-    float fadeL = 0.0f;
-    float fadeTargetL = 0.0f;
-    float waitL = 0.0f;
-
-    float fadeR = 0.0f;
-    float fadeTargetR = 0.0f;
-    float waitR = 0.0f;
-
-    float waitInc = 0.0f;
-    float coeff = 0.0f;
+    // Where the host blocks are in the current chunk, and what the last
+    // update chose for the blocks until the next one. The main bus layout
+    // is fixed between prepareToPlay() calls.
+    int chunkPosition = 0;
+    int interpolation = Interpolation::hermite;
+    bool isInputStereo = true;
+    bool isOutputStereo = true;
+
+    // output peaks since the meters were last updated
+    float peakL = 0.0f;
+    float peakR = 0.0f;
+
+    // per-sample values for the staged engine, one channel each
+    enum ScratchChannel
+    {
+        delayLChannel,
+        delayRChannel,
+        newDelayLChannel,
+        newDelayRChannel,
+        xfadeLChannel,
+        xfadeRChannel,
+        fadeLChannel,
+        fadeRChannel,
+        wetLChannel,
+        wetRChannel,
+        newWetLChannel,
+        newWetRChannel,
+        feedbackLChannel,
+        feedbackRChannel,
+        writeLChannel,
+        writeRChannel,
+        panLChannel,
+        panRChannel,
+        feedbackChannel,
+        driveChannel,
+        postWSGainChannel,
+        lowCutChannel,
+        lowCutQChannel,
+        highCutChannel,
+        highCutQChannel,
+        mixChannel,
+        gainChannel,
+        saturationLChannel,
+        saturationRChannel,
+        numScratchChannels
+    };
+    juce::AudioBuffer<float> scratch;
+
+    // delay time changes, one strategy per block
+    TimeChange::State timeChangeL, timeChangeR;
+    TimeChange::Coefficients timeChangeCoefficients;
+    int lastTimeChange = -1;
 
     bool lastBypass = false;
     float bypassXfade = 0.0f;
     float bypassXfadeInc = 0.0f;
-#endif
+
+    // the bypass crossfade is over and the DSP is skipped
+    bool fullyBypassed = false;
+
+    SilenceDetector silence;
+
+    // The tail as of the last update, and the one the host was told about,
+    // which it asks for from another thread. The timer tells it about changes
+    // at most once per interval.
+    static constexpr int tailUpdateInterval = 1000;
+    std::atomic<double> tailLength { 0.0 };
+    std::atomic<double> publishedTailLength { 0.0 };
 
     //==============================================================================
     JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR (DelayAudioProcessor)
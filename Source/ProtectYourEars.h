@@ -4,13 +4,14 @@
 
 // Silences the buffer if bad or loud values are detected in the output buffer.
 // Use this during debugging to avoid blowing out your eardrums on headphones.
-inline void protectYourEars(juce::AudioBuffer<float>& buffer)
+template <typename SampleType>
+inline void protectYourEars(juce::AudioBuffer<SampleType>& buffer)
 {
     bool firstWarning = true;
     for (int channel = 0; channel < buffer.getNumChannels(); ++channel) {
-        float* channelData = buffer.getWritePointer(channel);
+        SampleType* channelData = buffer.getWritePointer(channel);
         for (int sample = 0; sample < buffer.getNumSamples(); ++sample) {
-            float x = channelData[sample];
+            SampleType x = channelData[sample];
             bool silence = false;
             if (std::isnan(x)) {
                 DBG("!!! WARNING: nan detected in audio buffer, silencing !!!");
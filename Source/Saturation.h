@@ -0,0 +1,234 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE__) || defined(_M_X64) || defined(_M_AMD64)
+ #include <xmmintrin.h>
+ #define SATURATION_USE_SSE 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+ #include <arm_neon.h>
+ #define SATURATION_USE_NEON 1
+#endif
+
+// The tanh saturation in the feedback path, and cheaper curves that stand in
+// for it. All of them are odd, have a slope of 1 at 0 and stay within -1..1.
+// The errors are the largest difference from std::tanh over all inputs.
+namespace Saturation
+{
+    // Order matches the choices of the "Saturation" parameter.
+    enum Type
+    {
+        exact,
+        rational,
+        polynomial,
+        table
+    };
+
+#if SATURATION_USE_SSE
+    using Vector = __m128;
+
+    inline Vector load(const float* data) noexcept { return _mm_loadu_ps(data); }
+    inline void store(float* data, Vector value) noexcept { _mm_storeu_ps(data, value); }
+    inline Vector add(Vector a, Vector b) noexcept { return _mm_add_ps(a, b); }
+    inline Vector multiply(Vector a, Vector b) noexcept { return _mm_mul_ps(a, b); }
+    inline Vector divide(Vector a, Vector b) noexcept { return _mm_div_ps(a, b); }
+    inline Vector clamp(Vector value, float limit) noexcept { return _mm_max_ps(_mm_min_ps(value, _mm_set1_ps(limit)), _mm_set1_ps(-limit)); }
+    inline Vector splat(float value, Vector) noexcept { return _mm_set1_ps(value); }
+#elif SATURATION_USE_NEON
+    using Vector = float32x4_t;
+
+    inline Vector load(const float* data) noexcept { return vld1q_f32(data); }
+    inline void store(float* data, Vector value) noexcept { vst1q_f32(data, value); }
+    inline Vector add(Vector a, Vector b) noexcept { return vaddq_f32(a, b); }
+    inline Vector multiply(Vector a, Vector b) noexcept { return vmulq_f32(a, b); }
+    inline Vector divide(Vector a, Vector b) noexcept { return vdivq_f32(a, b); }
+    inline Vector clamp(Vector value, float limit) noexcept { return vmaxq_f32(vminq_f32(value, vdupq_n_f32(limit)), vdupq_n_f32(-limit)); }
+    inline Vector splat(float value, Vector) noexcept { return vdupq_n_f32(value); }
+#endif
+
+    // the scalar versions, so a curve is written once for both
+    inline float splat(float value, float) noexcept { return value; }
+    inline float add(float a, float b) noexcept { return a + b; }
+    inline float multiply(float a, float b) noexcept { return a * b; }
+    inline float divide(float a, float b) noexcept { return a / b; }
+    inline float clamp(float value, float limit) noexcept { return std::max(std::min(value, limit), -limit); }
+
+    // std::tanh, the reference
+    struct Exact
+    {
+        static constexpr bool vectorised = false;
+
+        static float process(float x) noexcept
+        {
+            return std::tanh(x);
+        }
+    };
+
+    // [7/6] Pade approximant, with the input clamped where it reaches 1.
+    // Max error 9.6e-5 near the clamp, below 1.1e-8 up to |x| = 2.
+    struct Rational
+    {
+        static constexpr bool vectorised = true;
+
+        template <typename T>
+        static T process(T x) noexcept
+        {
+            x = clamp(x, limit);
+            T x2 = multiply(x, x);
+
+            T numerator = add(multiply(add(multiply(add(x2, splat(378.0f, x)), x2), splat(17325.0f, x)), x2), splat(135135.0f, x));
+            T denominator = add(multiply(add(multiply(add(multiply(x2, splat(28.0f, x)), splat(3150.0f, x)), x2), splat(62370.0f, x)), x2), splat(135135.0f, x));
+            return clamp(divide(multiply(x, numerator), denominator), 1.0f);
+        }
+
+        static constexpr float limit = 4.97f;
+    };
+
+    // Odd polynomial of degree 7 that meets 1 with a slope of 0 at the clip
+    // point, a smooth hard clipper. No division. Max error 1.8e-2, so it is
+    // slightly brighter than tanh.
+    struct Polynomial
+    {
+        static constexpr bool vectorised = true;
+
+        template <typename T>
+        static T process(T x) noexcept
+        {
+            x = clamp(x, limit);
+            T x2 = multiply(x, x);
+
+            T polynomial = add(multiply(add(multiply(add(multiply(x2, splat(a7, x)), splat(a5, x)), x2), splat(a3, x)), x2), splat(1.0f, x));
+            return clamp(multiply(x, polynomial), 1.0f);
+        }
+
+        // p(limit) = 1 and p'(limit) = 0
+        static constexpr float limit = 2.38f;
+        static constexpr float a7 = -0.00323f;
+        static constexpr float a5 = 0.0481159f;
+        static constexpr float a3 = -0.271276f;
+    };
+
+    // tanh sampled every 1/128 up to where it is 1 in float, interpolated
+    // linearly. Max error 5.9e-6.
+    struct Table
+    {
+        static constexpr bool vectorised = false;
+
+        static constexpr int stepsPerUnit = 128;
+        static constexpr float limit = 9.0f;
+        static constexpr int numSteps = int(limit) * stepsPerUnit;
+
+        struct Values
+        {
+            Values() noexcept
+            {
+                for (int step = 0; step <= numSteps; ++step)
+                {
+                    values[step] = float(std::tanh(double(step) / stepsPerUnit));
+                }
+                values[numSteps + 1] = values[numSteps];
+            }
+
+            float values[numSteps + 2];
+        };
+
+        // built on first use, call once off the audio thread
+        static const Values& getValues() noexcept
+        {
+            static const Values values;
+            return values;
+        }
+
+        static float process(float x) noexcept
+        {
+            float position = std::min(std::abs(x), limit) * float(stepsPerUnit);
+            int step = int(position);
+            float weight = position - float(step);
+            const float* values = getValues().values;
+
+            float y = values[step] + (values[step + 1] - values[step]) * weight;
+            return std::copysign(y, x);
+        }
+    };
+
+    template <typename Curve>
+    void processBlock(float* data, const float* drive, const float* gain, int numSamples) noexcept
+    {
+        int sample = 0;
+
+#if SATURATION_USE_SSE || SATURATION_USE_NEON
+        if constexpr (Curve::vectorised)
+        {
+            for (; sample + 4 <= numSamples; sample += 4)
+            {
+                Vector x = multiply(load(drive + sample), load(data + sample));
+                store(data + sample, multiply(Curve::process(x), load(gain + sample)));
+            }
+        }
+#endif
+
+        for (; sample < numSamples; ++sample)
+        {
+            data[sample] = Curve::process(drive[sample] * data[sample]) * gain[sample];
+        }
+    }
+
+    // without drive and gain, for the oversampled signal
+    template <typename Curve>
+    void processBlock(float* data, int numSamples) noexcept
+    {
+        int sample = 0;
+
+#if SATURATION_USE_SSE || SATURATION_USE_NEON
+        if constexpr (Curve::vectorised)
+        {
+            for (; sample + 4 <= numSamples; sample += 4)
+            {
+                store(data + sample, Curve::process(load(data + sample)));
+            }
+        }
+#endif
+
+        for (; sample < numSamples; ++sample)
+        {
+            data[sample] = Curve::process(data[sample]);
+        }
+    }
+
+    // one sample, with the drive already applied
+    inline float processSample(int type, float x) noexcept
+    {
+        switch (type)
+        {
+            case rational:   return Rational::process(x);
+            case polynomial: return Polynomial::process(x);
+            case table:      return Table::process(x);
+            default:         return Exact::process(x);
+        }
+    }
+
+    // A block in place, scaled by drive on the way in and by gain on the way
+    // out, all per sample. The curve is picked once for the whole block.
+    inline void processBlock(int type, float* data, const float* drive, const float* gain, int numSamples) noexcept
+    {
+        switch (type)
+        {
+            case rational:   processBlock<Rational>(data, drive, gain, numSamples); break;
+            case polynomial: processBlock<Polynomial>(data, drive, gain, numSamples); break;
+            case table:      processBlock<Table>(data, drive, gain, numSamples); break;
+            default:         processBlock<Exact>(data, drive, gain, numSamples); break;
+        }
+    }
+
+    inline void processBlock(int type, float* data, int numSamples) noexcept
+    {
+        switch (type)
+        {
+            case rational:   processBlock<Rational>(data, numSamples); break;
+            case polynomial: processBlock<Polynomial>(data, numSamples); break;
+            case table:      processBlock<Table>(data, numSamples); break;
+            default:         processBlock<Exact>(data, numSamples); break;
+        }
+    }
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <JuceHeader.h>
+#include <algorithm>
+#include <limits>
+
+// Tells the processor when it can idle. Counts how many frames have been
+// written to the delay line since the last one above the threshold. Once that
+// reaches further back than the longest delay, every read is silent too, and
+// with a silent input the whole output is.
+class SilenceDetector
+{
+public:
+    static constexpr float threshold = 1.0e-6f; // -120 dB
+
+    // after a reset of the delay line, nothing audible is left in it
+    void reset() noexcept
+    {
+        numQuietFrames = maxQuietFrames;
+    }
+
+    // once per block written to the delay line, with the peak of the block
+    void written(float peak, int numFrames) noexcept
+    {
+        numQuietFrames = peak > threshold ? 0 : std::min(numQuietFrames + numFrames, maxQuietFrames);
+    }
+
+    // Whether the input block is silent and nothing above the threshold is
+    // left within maxDelayInSamples of the write head.
+    template <typename SampleType>
+    bool isIdle(const juce::AudioBuffer<SampleType>& input, int maxDelayInSamples) const noexcept
+    {
+        if (numQuietFrames < maxDelayInSamples)
+        {
+            return false;
+        }
+
+        for (int channel = 0; channel < input.getNumChannels(); ++channel)
+        {
+            if (input.getMagnitude(channel, 0, input.getNumSamples()) > SampleType(threshold))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // vectorised, for the blocks the staged engine writes in one go
+    static float getPeak(const float* data, int numSamples) noexcept
+    {
+        auto range = juce::FloatVectorOperations::findMinAndMax(data, numSamples);
+        return std::max(-range.getStart(), range.getEnd());
+    }
+
+private:
+    static constexpr int maxQuietFrames = std::numeric_limits<int>::max() / 2;
+
+    int numQuietFrames = maxQuietFrames;
+};
@@ -0,0 +1,234 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+#if defined(__SSE__) || defined(_M_X64) || defined(_M_AMD64)
+ #include <xmmintrin.h>
+ #define STATE_VARIABLE_FILTER_USE_SSE 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+ #include <arm_neon.h>
+ #define STATE_VARIABLE_FILTER_USE_NEON 1
+#endif
+
+// Stereo TPT state variable filter for the feedback path, the same topology
+// and output as juce::dsp::StateVariableTPTFilter. Setting the cutoff does
+// not call std::tan: the prewarped gain comes from a table, so the smoothed
+// cutoff can move every sample without the cost of a coefficient update.
+// Left and right run together, one lane each.
+class StateVariableFilter
+{
+public:
+    enum class Type
+    {
+        lowpass,
+        highpass
+    };
+
+    // tan(pi * f / sampleRate) for normalised frequencies f / sampleRate,
+    // keyed on the bits of the float, which is a log2 scale: each octave is
+    // split into stepsPerOctave linear steps. Interpolated linearly, that is
+    // within 0.05% of std::tan up to 0.45 of the sample rate.
+    struct GainTable
+    {
+        static constexpr int stepsPerOctave = 128;
+        static constexpr int lowestOctave = -20; // 2^-20, below 0.1 Hz at 96 kHz
+        static constexpr int numOctaves = -1 - lowestOctave; // up to Nyquist
+        static constexpr int numSteps = numOctaves * stepsPerOctave;
+        static constexpr int mantissaBits = 23;
+        static constexpr int fractionBits = mantissaBits - 7; // log2(stepsPerOctave)
+        static constexpr std::uint32_t lowestBits = std::uint32_t(127 + lowestOctave) << mantissaBits;
+
+        // below the table, tan(pi * f) is pi * f to float precision
+        static constexpr float lowest = 1.0f / float(1 << -lowestOctave);
+        static constexpr float highest = 0.49f;
+
+        GainTable() noexcept
+        {
+            const double pi = 3.14159265358979323846;
+
+            for (int step = 0; step <= numSteps; ++step)
+            {
+                int octave = lowestOctave + step / stepsPerOctave;
+                double frequency = std::ldexp(1.0 + double(step % stepsPerOctave) / stepsPerOctave, octave);
+                gains[step] = float(std::tan(pi * std::min(frequency, 0.5 - 1.0e-9)));
+            }
+        }
+
+        float getGain(float frequency) const noexcept
+        {
+            if (frequency < lowest)
+            {
+                return 3.14159265f * frequency;
+            }
+            frequency = std::min(frequency, highest);
+
+            std::uint32_t bits;
+            std::memcpy(&bits, &frequency, sizeof(bits));
+            bits -= lowestBits;
+
+            int step = int(bits >> fractionBits);
+            float weight = float(bits & ((1u << fractionBits) - 1)) * (1.0f / float(1 << fractionBits));
+            return gains[step] + (gains[step + 1] - gains[step]) * weight;
+        }
+
+        float gains[numSteps + 1];
+    };
+
+    // built on first use, call once off the audio thread
+    static const GainTable& getTable() noexcept
+    {
+        static const GainTable table;
+        return table;
+    }
+
+    void setType(Type newType) noexcept
+    {
+        type = newType;
+    }
+
+    void prepare(double sampleRate) noexcept
+    {
+        inverseSampleRate = float(1.0 / sampleRate);
+        updateCoefficients();
+    }
+
+    void reset() noexcept
+    {
+        s1[0] = s1[1] = 0.0f;
+        s2[0] = s2[1] = 0.0f;
+    }
+
+    // only recomputes the coefficients when a value has changed
+    void setParameters(float frequency, float newResonance) noexcept
+    {
+        if (frequency != cutoff || newResonance != resonance)
+        {
+            cutoff = frequency;
+            resonance = newResonance;
+            updateCoefficients();
+        }
+    }
+
+    void processStereo(float& left, float& right) noexcept
+    {
+        Pair state1 = makePair(s1[0], s1[1]);
+        Pair state2 = makePair(s2[0], s2[1]);
+
+        Pair output = tick(makePair(left, right), state1, state2, broadcast(g), broadcast(g + R2), broadcast(h));
+        left = getLeft(output);
+        right = getRight(output);
+
+        storeState(state1, state2);
+    }
+
+    // Both channels of a block in place, with the state kept in registers.
+    // The cutoff and resonance are per sample.
+    void processBlock(float* left, float* right, const float* cutoffs, const float* resonances,
+                      int numSamples) noexcept
+    {
+        Pair state1 = makePair(s1[0], s1[1]);
+        Pair state2 = makePair(s2[0], s2[1]);
+        Pair gain = broadcast(g);
+        Pair damping = broadcast(g + R2);
+        Pair scale = broadcast(h);
+
+        for (int sample = 0; sample < numSamples; ++sample)
+        {
+            if (cutoffs[sample] != cutoff || resonances[sample] != resonance)
+            {
+                cutoff = cutoffs[sample];
+                resonance = resonances[sample];
+                updateCoefficients();
+                gain = broadcast(g);
+                damping = broadcast(g + R2);
+                scale = broadcast(h);
+            }
+
+            Pair output = tick(makePair(left[sample], right[sample]), state1, state2, gain, damping, scale);
+            left[sample] = getLeft(output);
+            right[sample] = getRight(output);
+        }
+
+        storeState(state1, state2);
+    }
+
+private:
+    // left in lane 0, right in lane 1
+#if STATE_VARIABLE_FILTER_USE_SSE
+    using Pair = __m128;
+
+    static Pair makePair(float left, float right) noexcept { return _mm_unpacklo_ps(_mm_set_ss(left), _mm_set_ss(right)); }
+    static Pair broadcast(float value) noexcept { return _mm_set1_ps(value); }
+    static Pair add(Pair a, Pair b) noexcept { return _mm_add_ps(a, b); }
+    static Pair subtract(Pair a, Pair b) noexcept { return _mm_sub_ps(a, b); }
+    static Pair multiply(Pair a, Pair b) noexcept { return _mm_mul_ps(a, b); }
+    static float getLeft(Pair pair) noexcept { return _mm_cvtss_f32(pair); }
+    static float getRight(Pair pair) noexcept { return _mm_cvtss_f32(_mm_shuffle_ps(pair, pair, _MM_SHUFFLE(1, 1, 1, 1))); }
+#elif STATE_VARIABLE_FILTER_USE_NEON
+    using Pair = float32x2_t;
+
+    static Pair makePair(float left, float right) noexcept { return vset_lane_f32(right, vdup_n_f32(left), 1); }
+    static Pair broadcast(float value) noexcept { return vdup_n_f32(value); }
+    static Pair add(Pair a, Pair b) noexcept { return vadd_f32(a, b); }
+    static Pair subtract(Pair a, Pair b) noexcept { return vsub_f32(a, b); }
+    static Pair multiply(Pair a, Pair b) noexcept { return vmul_f32(a, b); }
+    static float getLeft(Pair pair) noexcept { return vget_lane_f32(pair, 0); }
+    static float getRight(Pair pair) noexcept { return vget_lane_f32(pair, 1); }
+#else
+    struct Pair
+    {
+        float left, right;
+    };
+
+    static Pair makePair(float left, float right) noexcept { return { left, right }; }
+    static Pair broadcast(float value) noexcept { return { value, value }; }
+    static Pair add(Pair a, Pair b) noexcept { return { a.left + b.left, a.right + b.right }; }
+    static Pair subtract(Pair a, Pair b) noexcept { return { a.left - b.left, a.right - b.right }; }
+    static Pair multiply(Pair a, Pair b) noexcept { return { a.left * b.left, a.right * b.right }; }
+    static float getLeft(Pair pair) noexcept { return pair.left; }
+    static float getRight(Pair pair) noexcept { return pair.right; }
+#endif
+
+    // one sample of both channels, the arithmetic of
+    // StateVariableTPTFilter::processSample()
+    Pair tick(Pair input, Pair& state1, Pair& state2, Pair gain, Pair damping, Pair scale) const noexcept
+    {
+        Pair yHP = multiply(scale, subtract(subtract(input, multiply(state1, damping)), state2));
+        Pair yBP = add(multiply(yHP, gain), state1);
+        state1 = add(multiply(yHP, gain), yBP);
+        Pair yLP = add(multiply(yBP, gain), state2);
+        state2 = add(multiply(yBP, gain), yLP);
+
+        return type == Type::lowpass ? yLP : yHP;
+    }
+
+    void storeState(Pair state1, Pair state2) noexcept
+    {
+        s1[0] = getLeft(state1);
+        s1[1] = getRight(state1);
+        s2[0] = getLeft(state2);
+        s2[1] = getRight(state2);
+    }
+
+    void updateCoefficients() noexcept
+    {
+        g = getTable().getGain(cutoff * inverseSampleRate);
+        R2 = 1.0f / resonance;
+        h = 1.0f / (1.0f + R2 * g + g * g);
+    }
+
+    Type type = Type::lowpass;
+    float inverseSampleRate = 1.0f / 44100.0f;
+    float cutoff = 1000.0f;
+    float resonance = 0.70710678f; // Butterworth
+
+    float g = 0.0f;
+    float R2 = 1.0f;
+    float h = 1.0f;
+
+    float s1[2] = { 0.0f, 0.0f };
+    float s2[2] = { 0.0f, 0.0f };
+};
@@ -0,0 +1,464 @@
+#include <JuceHeader.h>
+#include "StereoDelayLine.h"
+#include "HalfFloat.h"
+
+// frames converted at a time by the fixed-delay readBlock() of compact storage
+static constexpr int compactChunkFrames = 32;
+
+void StereoDelayLine::setMaximumDelayInSamples(int maxLengthInSamples, Storage newStorage)
+{
+    jassert(maxLengthInSamples > 0);
+
+    int paddedLength = juce::nextPowerOfTwo(maxLengthInSamples + padding);
+    if (bufferLength < paddedLength || storage != newStorage)
+    {
+        bufferLength = std::max(bufferLength, paddedLength);
+        mask = bufferLength - 1;
+        storage = newStorage;
+
+        // Not cleared, nothing is read before it has been written. The old
+        // block goes back to the pool first, so it can be reused right away.
+        auto numValues = static_cast<size_t>(numChannels * (bufferLength + guardFrames));
+        size_t sampleSize = getSampleSize();
+        memory.reset();
+        memory = DelayBufferPool::getInstance().acquire(numValues * sampleSize);
+
+        buffer = storage == Storage::full ? static_cast<float*>(memory.get()) : nullptr;
+        compactBuffer = storage == Storage::compact ? static_cast<std::uint16_t*>(memory.get()) : nullptr;
+        numWritten = 0;
+        position.store(writeIndex + 1, std::memory_order_relaxed);
+
+        DBG("StereoDelayLine: " << bufferLength + guardFrames << " frames ("
+            << int(numValues * sampleSize / 1024) << " kB) in use for "
+            << maxLengthInSamples + padding << " needed (+"
+            << juce::String(100.0 * (bufferLength + guardFrames) / (maxLengthInSamples + padding) - 100.0, 1) << " %)");
+    }
+}
+
+void StereoDelayLine::reset() noexcept
+{
+    // The write position carries on. A replacement filled before the reset
+    // counts from it, adopt() then still lines up and keeps numWritten at 0.
+    numWritten = 0;
+}
+
+void StereoDelayLine::write(float left, float right) noexcept
+{
+    jassert(bufferLength > 0);
+    writeIndex = (writeIndex + 1) & mask;
+
+    if (storage == Storage::compact)
+    {
+        writeFrame(compactBuffer, HalfFloat::fromFloat(left), HalfFloat::fromFloat(right));
+    }
+    else
+    {
+        writeFrame(buffer, left, right);
+    }
+
+    if (numWritten < bufferLength)
+    {
+        ++numWritten;
+    }
+
+    position.store(position.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+}
+
+template <typename Sample, int numTaps>
+const float* StereoDelayLine::getTaps(int channel, float delayInSamples, int offset, float& fraction,
+                                      [[maybe_unused]] float* window) const noexcept
+{
+    int integerDelay = int(delayInSamples);
+    fraction = delayInSamples - float(integerDelay);
+    int frame = numChannels * ((writeIndex + offset - integerDelay - numTaps / 2) & mask);
+
+    if constexpr (std::is_same_v<Sample, float>)
+    {
+        return buffer + frame + channel;
+    }
+    else
+    {
+        HalfFloat::toFloat(compactBuffer + frame, window, numTaps * numChannels);
+        window[numTaps * numChannels] = 0.0f;
+        return window + channel;
+    }
+}
+
+float StereoDelayLine::getSample(int index) const noexcept
+{
+    if (storage == Storage::compact)
+    {
+        return HalfFloat::toFloat(compactBuffer[static_cast<size_t>(index)]);
+    }
+    return buffer[static_cast<size_t>(index)];
+}
+
+template <typename Interpolator>
+float StereoDelayLine::read(int channel, float delayInSamples, Interpolation::State& state) const noexcept
+{
+    jassert(channel >= 0 && channel < numChannels);
+    jassert(delayInSamples >= float(Interpolator::numTaps / 2 - 1));
+    jassert(delayInSamples <= float(getMaximumDelay()));
+
+    if (storage == Storage::compact)
+    {
+        return readSample<std::uint16_t, Interpolator>(channel, delayInSamples, 0, state);
+    }
+    return readSample<float, Interpolator>(channel, delayInSamples, 0, state);
+}
+
+template <typename Sample, typename Interpolator>
+float StereoDelayLine::readSample(int channel, float delayInSamples, int offset, Interpolation::State& state) const noexcept
+{
+    if (!isWritten<Interpolator::numTaps>(delayInSamples, offset))
+    {
+        return readPartial<Interpolator>(channel, delayInSamples, offset, state);
+    }
+
+    float window[windowSize];
+    float fraction;
+    const float* taps = getTaps<Sample, Interpolator::numTaps>(channel, delayInSamples, offset, fraction, window);
+    return Interpolator::template interpolate<numChannels>(taps, fraction, state);
+}
+
+template <typename Interpolator>
+float StereoDelayLine::readPartial(int channel, float delayInSamples, int offset, Interpolation::State& state) const noexcept
+{
+    int integerDelay = int(delayInSamples);
+    float fraction = delayInSamples - float(integerDelay);
+
+    // age 0 is the newest frame, taps that have not been written are silent
+    int oldestAge = integerDelay + Interpolator::numTaps / 2 - offset;
+    float taps[Interpolator::numTaps];
+    for (int i = 0; i < Interpolator::numTaps; ++i)
+    {
+        int age = oldestAge - i;
+        taps[i] = age < numWritten ? getSample(numChannels * ((writeIndex - age) & mask) + channel) : 0.0f;
+    }
+    return Interpolator::template interpolate<1>(taps, fraction, state);
+}
+
+void StereoDelayLine::writeBlock(const float* left, const float* right, int numSamples) noexcept
+{
+    jassert(bufferLength > 0);
+
+    int sample = 0;
+    while (sample < numSamples)
+    {
+        int startIndex = (writeIndex + 1) & mask;
+
+        // interleave up to the end of the buffer, the rest goes to the start
+        int span = std::min(numSamples - sample, bufferLength - startIndex);
+        int numGuards = startIndex < guardFrames ? std::min(span, guardFrames - startIndex) : 0;
+
+        if (storage == Storage::compact)
+        {
+            std::uint16_t* frames = compactBuffer + numChannels * startIndex;
+
+            // interleaved in float first, then converted in one go
+            float chunk[numChannels * compactChunkFrames];
+            for (int chunkStart = 0; chunkStart < span; chunkStart += compactChunkFrames)
+            {
+                int chunkLength = std::min(compactChunkFrames, span - chunkStart);
+                for (int i = 0; i < chunkLength; ++i)
+                {
+                    chunk[numChannels * i] = left[sample + chunkStart + i];
+                    chunk[numChannels * i + 1] = right[sample + chunkStart + i];
+                }
+                HalfFloat::fromFloat(chunk, frames + numChannels * chunkStart, numChannels * chunkLength);
+            }
+
+            std::copy_n(frames, numChannels * numGuards, frames + numChannels * bufferLength);
+        }
+        else
+        {
+            float* frames = buffer + numChannels * startIndex;
+            for (int i = 0; i < span; ++i)
+            {
+                frames[numChannels * i] = left[sample + i];
+                frames[numChannels * i + 1] = right[sample + i];
+            }
+
+            std::copy_n(frames, numChannels * numGuards, frames + numChannels * bufferLength);
+        }
+
+        writeIndex = (startIndex + span - 1) & mask;
+        sample += span;
+    }
+
+    numWritten = std::min(bufferLength, numWritten + numSamples);
+    position.store(position.load(std::memory_order_relaxed) + numSamples, std::memory_order_release);
+}
+
+void StereoDelayLine::fillReplacement(Replacement& replacement, int maxLengthInSamples) const
+{
+    jassert(bufferLength > 0);
+
+    replacement.bufferLength = std::max(bufferLength, juce::nextPowerOfTwo(maxLengthInSamples + padding));
+    auto numValues = static_cast<size_t>(numChannels * (replacement.bufferLength + guardFrames));
+    replacement.memory = DelayBufferPool::getInstance().acquire(numValues * getSampleSize());
+
+    // The audio thread keeps writing while this copies. Frames are only
+    // overwritten a buffer length after they were written, so all frames
+    // newer than that are intact, counted from where writing got to by the
+    // end of the copy.
+    std::int64_t end = position.load(std::memory_order_acquire);
+    int newMask = replacement.bufferLength - 1;
+
+    if (storage == Storage::compact)
+    {
+        copyFrames(compactBuffer, mask, static_cast<std::uint16_t*>(replacement.memory.get()), newMask, end - bufferLength, end);
+    }
+    else
+    {
+        copyFrames(buffer, mask, static_cast<float*>(replacement.memory.get()), newMask, end - bufferLength, end);
+    }
+
+    replacement.copyEnd = end;
+    replacement.validFrom = position.load(std::memory_order_acquire) - bufferLength;
+}
+
+void StereoDelayLine::adopt(Replacement& replacement) noexcept
+{
+    jassert(replacement.bufferLength >= bufferLength);
+
+    // catch up on the frames written since the copy, the old buffer still
+    // has the last bufferLength of them
+    std::int64_t end = position.load(std::memory_order_relaxed);
+    std::int64_t begin = std::max(replacement.copyEnd, end - bufferLength);
+    std::int64_t validFrom = std::max(replacement.validFrom, end - bufferLength);
+    int newMask = replacement.bufferLength - 1;
+
+    if (storage == Storage::compact)
+    {
+        auto* frames = static_cast<std::uint16_t*>(replacement.memory.get());
+        copyFrames(compactBuffer, mask, frames, newMask, begin, end);
+        std::copy_n(frames, numChannels * guardFrames, frames + numChannels * replacement.bufferLength);
+    }
+    else
+    {
+        auto* frames = static_cast<float*>(replacement.memory.get());
+        copyFrames(buffer, mask, frames, newMask, begin, end);
+        std::copy_n(frames, numChannels * guardFrames, frames + numChannels * replacement.bufferLength);
+    }
+
+    std::swap(memory, replacement.memory);
+    std::swap(bufferLength, replacement.bufferLength);
+    buffer = storage == Storage::full ? static_cast<float*>(memory.get()) : nullptr;
+    compactBuffer = storage == Storage::compact ? static_cast<std::uint16_t*>(memory.get()) : nullptr;
+    mask = bufferLength - 1;
+    writeIndex = static_cast<int>((end - 1) & mask);
+    numWritten = static_cast<int>(std::min(std::int64_t(numWritten), end - validFrom));
+}
+
+template <typename Sample>
+void StereoDelayLine::copyFrames(const Sample* source, int sourceMask, Sample* destination, int destinationMask,
+                                 std::int64_t begin, std::int64_t end) noexcept
+{
+    while (begin < end)
+    {
+        auto sourceIndex = static_cast<int>(begin & sourceMask);
+        auto destinationIndex = static_cast<int>(begin & destinationMask);
+        auto span = static_cast<int>(std::min({ end - begin,
+                                                std::int64_t(sourceMask + 1 - sourceIndex),
+                                                std::int64_t(destinationMask + 1 - destinationIndex) }));
+
+        std::copy_n(source + numChannels * sourceIndex, numChannels * span, destination + numChannels * destinationIndex);
+        begin += span;
+    }
+}
+
+template <typename Interpolator>
+void StereoDelayLine::readBlock(int channel, float* output, int numSamples, float delayInSamples, Interpolation::State& state) const noexcept
+{
+    if (storage == Storage::compact)
+    {
+        readBlockFrom<std::uint16_t, Interpolator>(channel, output, numSamples, delayInSamples, state);
+    }
+    else
+    {
+        readBlockFrom<float, Interpolator>(channel, output, numSamples, delayInSamples, state);
+    }
+}
+
+template <typename Sample, typename Interpolator>
+void StereoDelayLine::readBlockFrom(int channel, float* output, int numSamples, float delayInSamples, Interpolation::State& state) const noexcept
+{
+    jassert(channel >= 0 && channel < numChannels);
+    jassert(delayInSamples >= float(Interpolator::numTaps / 2 - 1));
+    jassert(delayInSamples + float(numSamples - 1) <= float(getMaximumDelay()));
+
+    // the first sample reaches back furthest
+    if (!isWritten<Interpolator::numTaps>(delayInSamples, 1 - numSamples))
+    {
+        for (int sample = 0; sample < numSamples; ++sample)
+        {
+            output[sample] = readSample<Sample, Interpolator>(channel, delayInSamples, 1 - numSamples + sample, state);
+        }
+        return;
+    }
+
+    int integerDelay = int(delayInSamples);
+    float fraction = delayInSamples - float(integerDelay);
+
+    // oldest of the taps for the first sample of the block
+    int readIndexD = (writeIndex + 1 - numSamples - integerDelay - Interpolator::numTaps / 2) & mask;
+
+    // +1 for the stride-2 SIMD loads of the right channel, as in windowSize
+    [[maybe_unused]] float frames[numChannels * (compactChunkFrames + Interpolator::numTaps - 1) + 1];
+
+    int sample = 0;
+    while (sample < numSamples)
+    {
+        // all taps are in a row up to the end of the buffer, thanks to the guard frames
+        int span = std::min(numSamples - sample, bufferLength - readIndexD);
+        const float* taps;
+        if constexpr (std::is_same_v<Sample, float>)
+        {
+            taps = buffer + numChannels * readIndexD + channel;
+        }
+        else
+        {
+            span = std::min(span, compactChunkFrames);
+            HalfFloat::toFloat(compactBuffer + numChannels * readIndexD, frames, numChannels * (span + Interpolator::numTaps - 1));
+            frames[numChannels * (span + Interpolator::numTaps - 1)] = 0.0f;
+            taps = frames + channel;
+        }
+
+        for (int i = 0; i < span; ++i)
+        {
+            output[sample + i] = Interpolator::template interpolate<numChannels>(taps + numChannels * i, fraction, state);
+        }
+        sample += span;
+        readIndexD = (readIndexD + span) & mask;
+    }
+}
+
+template <typename Interpolator>
+void StereoDelayLine::readBlock(int channel, float* output, const float* delayInSamples, int numSamples, Interpolation::State& state) const noexcept
+{
+    if (storage == Storage::compact)
+    {
+        readBlockFrom<std::uint16_t, Interpolator>(channel, output, delayInSamples, numSamples, state);
+    }
+    else
+    {
+        readBlockFrom<float, Interpolator>(channel, output, delayInSamples, numSamples, state);
+    }
+}
+
+template <typename Sample, typename Interpolator>
+void StereoDelayLine::readBlockFrom(int channel, float* output, const float* delayInSamples, int numSamples, Interpolation::State& state) const noexcept
+{
+    jassert(channel >= 0 && channel < numChannels);
+
+    // sample i of the block was written numSamples - 1 - i writes ago
+    int offset = 1 - numSamples;
+    constexpr int numTaps = Interpolator::numTaps;
+
+    // four consecutive samples per call, sharing the interpolator state
+    Interpolation::State* states[] = { &state, &state, &state, &state };
+    const float* taps[4];
+    float fractions[4];
+    float windows[4][windowSize];
+
+    int sample = 0;
+    for (; sample + 4 <= numSamples; sample += 4)
+    {
+        const float* delays = delayInSamples + sample;
+        jassert(std::min({ delays[0], delays[1], delays[2], delays[3] }) >= float(numTaps / 2 - 1));
+        jassert(delays[0] + float(numSamples - 1 - sample) <= float(getMaximumDelay()));
+
+        if (!(isWritten<numTaps>(delays[0], offset + sample) && isWritten<numTaps>(delays[1], offset + sample + 1)
+              && isWritten<numTaps>(delays[2], offset + sample + 2) && isWritten<numTaps>(delays[3], offset + sample + 3)))
+        {
+            for (int i = 0; i < 4; ++i)
+            {
+                output[sample + i] = readSample<Sample, Interpolator>(channel, delays[i], offset + sample + i, state);
+            }
+            continue;
+        }
+
+        taps[0] = getTaps<Sample, numTaps>(channel, delays[0], offset + sample, fractions[0], windows[0]);
+        taps[1] = getTaps<Sample, numTaps>(channel, delays[1], offset + sample + 1, fractions[1], windows[1]);
+        taps[2] = getTaps<Sample, numTaps>(channel, delays[2], offset + sample + 2, fractions[2], windows[2]);
+        taps[3] = getTaps<Sample, numTaps>(channel, delays[3], offset + sample + 3, fractions[3], windows[3]);
+        Interpolation::interpolateLanes<Interpolator, numChannels>(taps, fractions, states, output + sample, 4);
+    }
+
+    for (; sample < numSamples; ++sample)
+    {
+        float delay = delayInSamples[sample];
+        jassert(delay >= float(numTaps / 2 - 1));
+        jassert(delay + float(numSamples - 1 - sample) <= float(getMaximumDelay()));
+
+        output[sample] = readSample<Sample, Interpolator>(channel, delay, offset + sample, state);
+    }
+}
+
+template <typename Interpolator>
+void StereoDelayLine::readLanes(const float* delayInSamples, Interpolation::State* const* states,
+                                float* output, int numLanes) const noexcept
+{
+    if (storage == Storage::compact)
+    {
+        readLanesFrom<std::uint16_t, Interpolator>(delayInSamples, states, output, numLanes);
+    }
+    else
+    {
+        readLanesFrom<float, Interpolator>(delayInSamples, states, output, numLanes);
+    }
+}
+
+template <typename Sample, typename Interpolator>
+void StereoDelayLine::readLanesFrom(const float* delayInSamples, Interpolation::State* const* states,
+                                    float* output, int numLanes) const noexcept
+{
+    jassert(numLanes > 0 && numLanes <= 4);
+
+    bool allWritten = true;
+    for (int lane = 0; lane < numLanes; ++lane)
+    {
+        jassert(delayInSamples[lane] >= float(Interpolator::numTaps / 2 - 1));
+        jassert(delayInSamples[lane] <= float(getMaximumDelay()));
+        allWritten = allWritten && isWritten<Interpolator::numTaps>(delayInSamples[lane], 0);
+    }
+
+    if (!allWritten)
+    {
+        for (int lane = 0; lane < numLanes; ++lane)
+        {
+            output[lane] = readSample<Sample, Interpolator>(lane & 1, delayInSamples[lane], 0, *states[lane]);
+        }
+        return;
+    }
+
+    // unused lanes repeat the first reads, their results are ignored
+    int lane1 = numLanes > 1 ? 1 : 0;
+    int lane2 = numLanes > 2 ? 2 : 0;
+    int lane3 = numLanes > 3 ? 3 : lane1;
+
+    // written out rather than looped, this keeps the lane setup in registers
+    const float* taps[4];
+    float fractions[4];
+    float windows[4][windowSize];
+    taps[0] = getTaps<Sample, Interpolator::numTaps>(0, delayInSamples[0], 0, fractions[0], windows[0]);
+    taps[1] = getTaps<Sample, Interpolator::numTaps>(lane1 & 1, delayInSamples[lane1], 0, fractions[1], windows[1]);
+    taps[2] = getTaps<Sample, Interpolator::numTaps>(0, delayInSamples[lane2], 0, fractions[2], windows[2]);
+    taps[3] = getTaps<Sample, Interpolator::numTaps>(lane3 & 1, delayInSamples[lane3], 0, fractions[3], windows[3]);
+
+    Interpolation::interpolateLanes<Interpolator, numChannels>(taps, fractions, states, output, numLanes);
+}
+
+#define INSTANTIATE_READS(Interpolator) \
+    template float StereoDelayLine::read<Interpolator>(int, float, Interpolation::State&) const noexcept; \
+    template void StereoDelayLine::readBlock<Interpolator>(int, float*, int, float, Interpolation::State&) const noexcept; \
+    template void StereoDelayLine::readBlock<Interpolator>(int, float*, const float*, int, Interpolation::State&) const noexcept; \
+    template void StereoDelayLine::readLanes<Interpolator>(const float*, Interpolation::State* const*, float*, int) const noexcept;
+
+INSTANTIATE_READS(Interpolation::Nearest)
+INSTANTIATE_READS(Interpolation::Linear)
+INSTANTIATE_READS(Interpolation::Hermite)
+INSTANTIATE_READS(Interpolation::Lagrange)
+INSTANTIATE_READS(Interpolation::Thiran)
+INSTANTIATE_READS(Interpolation::Sinc)
@@ -0,0 +1,171 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include "Interpolation.h"
+#include "DelayBufferPool.h"
+// Both channels share one buffer, stored interleaved as L R L R ..., so a
+// stereo read touches the same cache lines for L and R at equal delays and
+// the two channels never evict each other.
+class StereoDelayLine
+{
+public:
+    static constexpr int numChannels = 2;
+
+    // Full keeps 32-bit floats. Compact keeps IEEE half floats, half the
+    // memory and bandwidth, for 70 to 80 dB of signal to quantization noise.
+    enum class Storage
+    {
+        full,
+        compact
+    };
+
+    // Only ever grows, but changing the storage always reallocates.
+    void setMaximumDelayInSamples(int maxLengthInSamples, Storage newStorage = Storage::full);
+
+    // Constant time, the buffer is not cleared. Samples from before the reset
+    // read as silence until they have been overwritten.
+    void reset() noexcept;
+    void write(float left, float right) noexcept;
+
+    // Reads are specialized for one of the policies in Interpolation.h.
+    // The state is only used by recursive interpolators, keep one per read tap.
+    template <typename Interpolator>
+    float read(int channel, float delayInSamples, Interpolation::State& state) const noexcept;
+
+    // Block versions of write()/read(). readBlock() returns for every sample
+    // what read() would have returned right after the matching write() of the
+    // last numSamples writes, so call it after writeBlock().
+    void writeBlock(const float* left, const float* right, int numSamples) noexcept;
+    template <typename Interpolator>
+    void readBlock(int channel, float* output, int numSamples, float delayInSamples, Interpolation::State& state) const noexcept;
+    template <typename Interpolator>
+    void readBlock(int channel, float* output, const float* delayInSamples, int numSamples, Interpolation::State& state) const noexcept;
+
+    // Up to four reads in one go, the lanes alternate between the channels:
+    // L and R, followed by both crossfade taps. Two lanes return a stereo
+    // frame. The output must have room for four values.
+    template <typename Interpolator>
+    void readLanes(const float* delayInSamples, Interpolation::State* const* states, float* output, int numLanes) const noexcept;
+
+    // length of one channel, always a power of two so indices wrap with a mask
+    int getBufferLength() const noexcept
+    {
+        return bufferLength;
+    }
+
+    Storage getStorage() const noexcept
+    {
+        return storage;
+    }
+
+    bool fits(int maxLengthInSamples) const noexcept
+    {
+        return maxLengthInSamples + padding <= bufferLength;
+    }
+
+    // longest delay any interpolator can read, in samples
+    int getMaximumDelay() const noexcept
+    {
+        return bufferLength - padding;
+    }
+
+    // Growing while the line is in use. fillReplacement() allocates a longer
+    // buffer and copies the history while the audio thread keeps writing, so
+    // it is not for the audio thread. adopt() swaps it in on the audio thread
+    // and catches up on the frames written in the meantime. The old memory
+    // leaves in the replacement.
+    struct Replacement
+    {
+        DelayBufferPool::Block memory;
+        int bufferLength = 0;
+        std::int64_t copyEnd = 0;   // position the copy went up to
+        std::int64_t validFrom = 0; // oldest frame the copy got intact
+    };
+    void fillReplacement(Replacement& replacement, int maxLengthInSamples) const;
+    void adopt(Replacement& replacement) noexcept;
+
+private:
+    // Sample is float for full storage, std::uint16_t for compact storage.
+    template <typename Sample, typename Interpolator>
+    float readSample(int channel, float delayInSamples, int offset, Interpolation::State& state) const noexcept;
+    template <typename Sample, typename Interpolator>
+    void readBlockFrom(int channel, float* output, int numSamples, float delayInSamples, Interpolation::State& state) const noexcept;
+    template <typename Sample, typename Interpolator>
+    void readBlockFrom(int channel, float* output, const float* delayInSamples, int numSamples, Interpolation::State& state) const noexcept;
+    template <typename Sample, typename Interpolator>
+    void readLanesFrom(const float* delayInSamples, Interpolation::State* const* states, float* output, int numLanes) const noexcept;
+    template <typename Interpolator>
+    float readPartial(int channel, float delayInSamples, int offset, Interpolation::State& state) const noexcept;
+
+    // Whether all taps of a read made offset writes from now have been
+    // written since the last reset. Always true once the buffer has filled up.
+    template <int numTaps>
+    bool isWritten(float delayInSamples, int offset) const noexcept
+    {
+        return int(delayInSamples) + numTaps / 2 - offset < numWritten;
+    }
+
+    // Compact frames are converted to float for reading, the taps of both
+    // channels plus one value for the vector loads of the right channel.
+    static constexpr int windowSize = Interpolation::maxNumTaps * numChannels + 1;
+
+    // Oldest of the numTaps taps of a channel for a read made offset writes
+    // from now. The guard frames past the end of the buffer keep them all in
+    // a row. Full storage reads straight from the buffer, compact storage
+    // converts the frames into the window first.
+    template <typename Sample, int numTaps>
+    const float* getTaps(int channel, float delayInSamples, int offset, float& fraction, float* window) const noexcept;
+
+    float getSample(int index) const noexcept;
+
+    // frames begin to end, frame p at p & mask in either buffer
+    template <typename Sample>
+    static void copyFrames(const Sample* source, int sourceMask, Sample* destination, int destinationMask,
+                           std::int64_t begin, std::int64_t end) noexcept;
+
+    size_t getSampleSize() const noexcept
+    {
+        return storage == Storage::compact ? sizeof(std::uint16_t) : sizeof(float);
+    }
+
+    template <typename Sample>
+    void writeFrame(Sample* samples, Sample left, Sample right) noexcept
+    {
+        Sample* frame = samples + numChannels * writeIndex;
+        frame[0] = left;
+        frame[1] = right;
+
+        if (writeIndex < guardFrames)
+        {
+            Sample* guard = frame + numChannels * bufferLength;
+            guard[0] = left;
+            guard[1] = right;
+        }
+    }
+
+    // copies of the first frames, stored past the end of the buffer; one more
+    // than the interpolators need, so vector loads of the right channel fit
+    static constexpr int guardFrames = Interpolation::maxNumTaps;
+
+    // frames a buffer needs beyond the longest delay, for the older half of
+    // the taps and the frame being written
+    static constexpr int padding = Interpolation::maxNumTaps / 2 + 1;
+
+    // from the shared pool, only the pointer matching the storage is set
+    DelayBufferPool::Block memory;
+    float* buffer = nullptr;
+    std::uint16_t* compactBuffer = nullptr;
+    Storage storage = Storage::full;
+
+    int bufferLength = 0;
+    int mask = 0;
+    int writeIndex = 0;
+
+    // frames written since the last reset, up to bufferLength
+    int numWritten = 0;
+
+    // Counts every write, frame p lives at p & mask. Published for the copy
+    // in fillReplacement(), only the audio thread changes it.
+    std::atomic<std::int64_t> position { 0 };
+};
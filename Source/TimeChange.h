@@ -0,0 +1,255 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+
+// What the delay does when its time changes. Each strategy is a policy that
+// moves a State: setTarget() takes the delay target once per block,
+// beforeRead() sets up the values for reading a sample and afterRead()
+// advances the transition once it has been read. Only a channel in
+// transition needs the per-sample calls, a steady one reads the same delay
+// all block. The strategies share the State, so the processor can pick one
+// per block and switch between them mid-stream.
+namespace TimeChange
+{
+    // Order matches the choices of the "Time Change" parameter.
+    enum Type
+    {
+        glide,
+        crossfade,
+        duck
+    };
+
+    // per-sample steps, set from the sample rate
+    struct Coefficients
+    {
+        float glide = 0.0f;
+        float xfadeInc = 0.0f;
+        float waitInc = 0.0f;
+        float duck = 0.0f;
+
+        void prepare(double sampleRate) noexcept
+        {
+            glide = 1.0f - std::exp(-1.0f / (0.2f * static_cast<float>(sampleRate))); // 200 ms to 63.2%
+            xfadeInc = static_cast<float>(1.0 / (0.05 * sampleRate)); // 50 ms
+            waitInc = 1.0f / (0.3f * static_cast<float>(sampleRate)); // 300 ms
+            duck = 1.0f - std::exp(-1.0f / (0.05f * static_cast<float>(sampleRate))); // 50 ms to 63.2%
+        }
+    };
+
+    // One-pole step that always arrives. Once the step is too small to change
+    // a float it moves by one ulp at a time, instead of stalling short of the
+    // target forever.
+    inline float approach(float value, float target, float coefficient) noexcept
+    {
+        float next = value + (target - value) * coefficient;
+        return next != value ? next : std::nextafter(value, target);
+    }
+
+    // One channel, delays in samples. A delay of 0 means nothing has been
+    // read yet, the first target is taken as it is.
+    struct State
+    {
+        float delay = 0.0f;
+
+        // where the delay is heading, and the latest target of the block
+        float target = 0.0f;
+        float next = 0.0f;
+
+        // crossfade position and duck wait, 0 when idle
+        float xfade = 0.0f;
+        float wait = 0.0f;
+
+        // gain of the wet signal
+        float fade = 1.0f;
+        float fadeTarget = 1.0f;
+
+        void reset() noexcept
+        {
+            *this = State();
+        }
+
+        // Drops any transition in progress and keeps reading the current
+        // delay. The next strategy then takes the target its own way.
+        void handOver() noexcept
+        {
+            target = delay;
+            next = delay;
+            xfade = 0.0f;
+            wait = 0.0f;
+            fade = 1.0f;
+            fadeTarget = 1.0f;
+        }
+
+        // nothing moves until the target changes
+        bool isSteady() const noexcept
+        {
+            return delay == next && xfade == 0.0f && wait == 0.0f && fade == 1.0f;
+        }
+
+        // the second read of a crossfade
+        float getNewDelay() const noexcept
+        {
+            return xfade > 0.0f ? target : delay;
+        }
+
+        // shortest delay read until the current transition is over, once
+        // the delay has been set
+        float getShortestDelay() const noexcept
+        {
+            return std::min({ delay, target, next });
+        }
+    };
+
+    // One-pole glide towards the target. Repitches the echoes.
+    struct Glide
+    {
+        static constexpr bool crossfades = false;
+        static constexpr bool ducks = false;
+
+        static void setTarget(State& state, float target, const Coefficients&) noexcept
+        {
+            state.next = target;
+            state.target = target;
+
+            if (state.delay == 0.0f)
+            {
+                state.delay = target;
+            }
+        }
+
+        static void beforeRead(State& state, const Coefficients& coefficients) noexcept
+        {
+            state.delay = approach(state.delay, state.target, coefficients.glide);
+        }
+
+        static void afterRead(State&, const Coefficients&) noexcept
+        {
+        }
+    };
+
+    // Reads the old and the new delay and crossfades between them. Changes
+    // that arrive during a crossfade wait for it to finish.
+    struct Crossfade
+    {
+        static constexpr bool crossfades = true;
+        static constexpr bool ducks = false;
+
+        static void setTarget(State& state, float target, const Coefficients&) noexcept
+        {
+            state.next = target;
+
+            if (state.delay == 0.0f)
+            {
+                state.delay = target;
+                state.target = target;
+            }
+        }
+
+        static void beforeRead(State& state, const Coefficients& coefficients) noexcept
+        {
+            if (state.xfade == 0.0f)
+            {
+                state.target = state.next;
+
+                if (state.target != state.delay)
+                {
+                    state.xfade = coefficients.xfadeInc;
+                }
+            }
+        }
+
+        static void afterRead(State& state, const Coefficients& coefficients) noexcept
+        {
+            if (state.xfade > 0.0f)
+            {
+                state.xfade += coefficients.xfadeInc;
+                if (state.xfade >= 1.0f)
+                {
+                    state.delay = state.target;
+                    state.xfade = 0.0f;
+                }
+            }
+        }
+    };
+
+    // Fades the wet signal out, jumps to the new delay once it has been quiet
+    // for a while and fades back in. Changes restart the wait.
+    struct Duck
+    {
+        static constexpr bool crossfades = false;
+        static constexpr bool ducks = true;
+
+        static void setTarget(State& state, float target, const Coefficients& coefficients) noexcept
+        {
+            state.next = target;
+
+            if (target != state.target)
+            {
+                state.target = target;
+
+                if (state.delay == 0.0f)
+                {
+                    state.delay = state.target;
+                }
+                else
+                {
+                    state.wait = coefficients.waitInc;
+                    state.fadeTarget = 0.0f;
+                }
+            }
+        }
+
+        static void beforeRead(State& state, const Coefficients& coefficients) noexcept
+        {
+            state.fade = approach(state.fade, state.fadeTarget, coefficients.duck);
+        }
+
+        static void afterRead(State& state, const Coefficients& coefficients) noexcept
+        {
+            if (state.wait > 0.0f)
+            {
+                state.wait += coefficients.waitInc;
+                if (state.wait >= 1.0f)
+                {
+                    state.delay = state.target;
+                    state.wait = 0.0f;
+                    state.fadeTarget = 1.0f; // fade in
+                }
+            }
+        }
+    };
+
+    // Runs one channel through a block and fills the per-sample delays, plus
+    // the crossfade and fade values the strategy uses. A steady channel only
+    // gets its delays and returns false.
+    template <typename Strategy>
+    bool render(State& state, float* delays, float* newDelays, float* xfades, float* fades,
+                int numSamples, const Coefficients& coefficients) noexcept
+    {
+        if (state.isSteady())
+        {
+            std::fill_n(delays, numSamples, state.delay);
+            return false;
+        }
+
+        for (int sample = 0; sample < numSamples; ++sample)
+        {
+            Strategy::beforeRead(state, coefficients);
+
+            delays[sample] = state.delay;
+            if constexpr (Strategy::crossfades)
+            {
+                newDelays[sample] = state.getNewDelay();
+                xfades[sample] = state.xfade;
+            }
+            if constexpr (Strategy::ducks)
+            {
+                fades[sample] = state.fade;
+            }
+
+            Strategy::afterRead(state, coefficients);
+        }
+        return true;
+    }
+}